@@ -4,8 +4,21 @@
 #include "board/basic.hpp"
 #include "board/grid_point.hpp"
 #include "board/board_grid.hpp"
+#include "board/padded_layout.hpp"
+#include "board/point_set.hpp"
+#include "board/bitboard.hpp"
+#include "board/zobrist.hpp"
+#include "board/half_float.hpp"
+#include "board/pattern_table.hpp"
 #include "board/group_node.hpp"
+#include "board/group_pool.hpp"
 #include "board/pos_group.hpp"
 #include "board/board_class.hpp"
 #include "board/board_class_templ_header.hpp"
+#include "board/feature_cache.hpp"
+#include "board/playout.hpp"
+#include "board/playout_runner.hpp"
+#include "board/mcts.hpp"
+#include "board/transposition_table.hpp"
+#include "board/tactical_reader.hpp"
 #endif
@@ -6,11 +6,13 @@
 #define GO_AI_BASIC_HPP
 
 #include <cstddef>
+#include <cstdint>
 namespace board
 {
-    enum struct PointState { NA, W, B }; // state of a point on board
+    enum struct PointState: std::uint8_t { NA, W, B }; // state of a point on board
     static const std::size_t PointStateBits = 2; // Can be represented in 2 bits since 2 < 2 ^ 2
     enum struct Player { W, B }; // White or Black side
+    using GroupId = std::uint16_t; // Index of a group in GroupPool
     inline constexpr PointState getPointStateFromPlayer(Player p)
     {
         return p == Player::B ? PointState::B : PointState::W;
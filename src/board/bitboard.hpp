@@ -0,0 +1,184 @@
+#ifndef GO_AI_BITBOARD_HPP
+#define GO_AI_BITBOARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include "grid_point.hpp"
+
+// Instructions used by Bitboard are chosen at compile time, see option libgoboard_SIMD in CMakeLists.txt
+#if defined(LIBGOBOARD_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(LIBGOBOARD_SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace board
+{
+    // Set of points on Board<W, H> stored as one 32-bit row per line x, bit y of row x being point (x, y).
+    // Rows are surrounded by rows which are always 0, so the neighbours of all points are found
+    // with a few shifts and offset loads, 8 (AVX2) or 4 (SSE2) rows at a time.
+    // Board keeps one per PointState for queries of whole sets of points. It is not a second engine:
+    // groups, liberty counts and captures in place() are updated point by point as before.
+    template<std::size_t W, std::size_t H>
+    class Bitboard
+    {
+        static_assert(W <= 32, "A row of Bitboard must fit in 32 bits");
+    public:
+        using PointType = GridPoint<W, H>;
+    private:
+        static const std::size_t LANES = 8; // rows per step. AVX2 does 1 step of 8, SSE2 2 steps of 4
+        static const std::size_t BODY = (H + LANES - 1) / LANES * LANES; // rows computed, including some beyond H
+        static const std::size_t ROWS = BODY + 2; // row x is rows_[x + 1]
+        static const std::uint32_t ROW_MASK = W == 32 ? ~std::uint32_t(0) : (std::uint32_t(1) << W) - 1;
+
+        std::array<std::uint32_t, ROWS> rows_ {}; // Only read with unaligned loads, so Board needs no over-alignment
+
+    public:
+        static Bitboard full()
+        {
+            Bitboard b;
+            for (std::size_t i = 1; i <= H; ++i)
+                b.rows_[i] = ROW_MASK;
+            return b;
+        }
+
+        bool test(PointType p) const
+        {
+            return (rows_[p.x + 1] >> p.y) & 1;
+        }
+        void set(PointType p)
+        {
+            rows_[p.x + 1] |= std::uint32_t(1) << p.y;
+        }
+        void reset(PointType p)
+        {
+            rows_[p.x + 1] &= ~(std::uint32_t(1) << p.y);
+        }
+        void clear()
+        {
+            rows_.fill(0);
+        }
+
+        Bitboard &operator|=(const Bitboard &other)
+        {
+            for (std::size_t i = 1; i <= H; ++i)
+                rows_[i] |= other.rows_[i];
+            return *this;
+        }
+        Bitboard &operator&=(const Bitboard &other)
+        {
+            for (std::size_t i = 1; i <= H; ++i)
+                rows_[i] &= other.rows_[i];
+            return *this;
+        }
+        // Remove points of other
+        Bitboard &operator-=(const Bitboard &other)
+        {
+            for (std::size_t i = 1; i <= H; ++i)
+                rows_[i] &= ~other.rows_[i];
+            return *this;
+        }
+        friend Bitboard operator|(Bitboard a, const Bitboard &b)
+        {
+            return a |= b;
+        }
+        friend Bitboard operator&(Bitboard a, const Bitboard &b)
+        {
+            return a &= b;
+        }
+        friend Bitboard operator-(Bitboard a, const Bitboard &b)
+        {
+            return a -= b;
+        }
+        bool operator==(const Bitboard &other) const
+        {
+            return rows_ == other.rows_;
+        }
+        bool operator!=(const Bitboard &other) const
+        {
+            return !(*this == other);
+        }
+
+        bool any() const
+        {
+            std::uint32_t acc = 0;
+            for (std::size_t i = 1; i <= H; ++i)
+                acc |= rows_[i];
+            return acc != 0;
+        }
+        std::size_t count() const
+        {
+            std::size_t cnt = 0;
+            for (std::size_t i = 1; i <= H; ++i)
+                cnt += __builtin_popcount(rows_[i]);
+            return cnt;
+        }
+        // Call f(PointType) on every point in the set, in order of x * W + y
+        template<typename FT>
+        void forEach(FT f) const
+        {
+            for (std::size_t i = 1; i <= H; ++i)
+                for (std::uint32_t row = rows_[i]; row != 0; row &= row - 1)
+                    f(PointType(static_cast<char>(i - 1), static_cast<char>(__builtin_ctz(row))));
+        }
+
+        // These points together with all points adjacent to them.
+        // Columns beyond W are masked off in registers, and rows beyond H computed by SIMD steps are cleared after.
+        Bitboard dilate() const
+        {
+            Bitboard b;
+            const std::uint32_t *src = rows_.data();
+            std::uint32_t *dst = b.rows_.data();
+#if defined(LIBGOBOARD_SIMD_AVX2)
+            const __m256i mask = _mm256_set1_epi32(static_cast<int>(ROW_MASK));
+            for (std::size_t i = 1; i <= BODY; i += 8)
+            {
+                __m256i mid = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                __m256i up = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - 1));
+                __m256i down = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 1));
+                __m256i r = _mm256_or_si256(_mm256_or_si256(mid, _mm256_slli_epi32(mid, 1)),
+                                            _mm256_or_si256(_mm256_srli_epi32(mid, 1), _mm256_or_si256(up, down)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_and_si256(r, mask));
+            }
+            for (std::size_t i = H + 1; i <= BODY; ++i)
+                dst[i] = 0;
+#elif defined(LIBGOBOARD_SIMD_SSE2)
+            const __m128i mask = _mm_set1_epi32(static_cast<int>(ROW_MASK));
+            for (std::size_t i = 1; i <= BODY; i += 4)
+            {
+                __m128i mid = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - 1));
+                __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 1));
+                __m128i r = _mm_or_si128(_mm_or_si128(mid, _mm_slli_epi32(mid, 1)),
+                                         _mm_or_si128(_mm_srli_epi32(mid, 1), _mm_or_si128(up, down)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_and_si128(r, mask));
+            }
+            for (std::size_t i = H + 1; i <= BODY; ++i)
+                dst[i] = 0;
+#else
+            for (std::size_t i = 1; i <= H; ++i)
+                dst[i] = (src[i] | (src[i] << 1) | (src[i] >> 1) | src[i - 1] | src[i + 1]) & ROW_MASK;
+#endif
+            return b;
+        }
+        // Points adjacent to these points but not in them
+        Bitboard neighbours() const
+        {
+            return dilate() - *this;
+        }
+        // Points of area connected to seed through adjacent points of area. seed should be inside area
+        static Bitboard floodFill(Bitboard seed, const Bitboard &area)
+        {
+            seed &= area;
+            for (;;)
+            {
+                Bitboard next = seed.dilate() & area;
+                if (next == seed)
+                    return seed;
+                seed = next;
+            }
+        }
+    };
+}
+#endif //GO_AI_BITBOARD_HPP
@@ -13,18 +13,31 @@
 #include "basic.hpp"
 #include "grid_point.hpp"
 #include "group_node.hpp"
+#include "group_pool.hpp"
 #include "pos_group.hpp"
 #include "board_grid.hpp"
+#include "padded_layout.hpp"
+#include "point_set.hpp"
+#include "bitboard.hpp"
+#include "zobrist.hpp"
+#include "hash_history.hpp"
+#include "half_float.hpp"
+#include "pattern_table.hpp"
 #include <ostream>
 #include <vector>
 #include <cassert>
 #include <memory>
 #include <map>
 #include <queue>
+#include <deque>
 #include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <type_traits>
 #include <logger.hpp>
 #include <spdlog/fmt/ostr.h>
 #include "message.pb.h"
+#include "message_v3.pb.h"
 
 namespace board
 {
@@ -40,6 +53,12 @@ namespace std
     struct hash<board::Board<W, H>>;
 }
 
+namespace board
+{
+    template<std::size_t W, std::size_t H>
+    class FeatureCache;
+}
+
 namespace board
 {
     template <std::size_t W, std::size_t H>
@@ -50,121 +69,183 @@ namespace board
         static const std::size_t INIT_LASTSTATEHASH = 0x24512211u,
             INIT_CURSTATEHASH = 0xc7151360u;
         static const std::size_t MAX_HISTORY_LENGTH = 7;
-        std::shared_ptr<spdlog::logger> logger = getGlobalLogger();
-        BoardGrid<W, H> boardGrid_;
-        std::list< GroupNode<W, H> > groupNodeList_;
-        PosGroup<W, H> posGroup_ = {groupNodeList_.end()};
+        using GroupPoolType = GroupPool<W, H>;
+        using PosGroupType = PosGroup<W, H>;
+        using ZobristType = Zobrist<W, H>;
+        using LayoutType = PaddedLayout<W, H>;
+        // Positions remembered for superko: the latest MAX_SIZE (at least W * H) of them, so a cycle shorter than
+        // that is always detected. The oldest is forgotten first, and undo() brings it back.
+        using SuperkoHistoryType = HashHistory< nextPowerOf2(W * H) * 2 >;
+        static const GroupId NO_GROUP = GroupPoolType::NONE;
+
+        // Every member is trivially copyable, so is Board: copying a board is a plain memcpy.
+        // State of every vertex of PaddedLayout, with BORDER around the board
+        std::array<PointState, LayoutType::SIZE> cells_;
+        GroupPoolType groups_;
+        PosGroupType posGroup_ = {NO_GROUP};
         std::size_t step_ = 0;
         std::size_t lastStateHash_ = INIT_LASTSTATEHASH; // The hash of board 1 steps before. Used to validate ko.
         std::size_t curStateHash_ = INIT_CURSTATEHASH; // Hash of current board
-        using PosGroupType = PosGroup<W, H>;
+        std::uint64_t zobristHash_ = 0; // Zobrist hash of stones on board, updated on every change of cells_
+        bool superko_ = false;
+        SuperkoHistoryType superkoHistory_;
+
+        static spdlog::logger *logger()
+        {
+            static const std::shared_ptr<spdlog::logger> globalLogger = getGlobalLogger();
+            return globalLogger.get();
+        }
 
     public:
         using PointType = GridPoint<W, H>;
         using GroupNodeType = GroupNode<W, H>;
-        using GroupListType = std::list< GroupNodeType >;
-        using GroupIterator = typename GroupListType::iterator;
-        using GroupConstIterator = typename GroupListType::const_iterator;
+        using GroupConstIterator = typename GroupPoolType::const_iterator;
+        using PointSetType = PointSet<W, H>;
+        using BitboardType = Bitboard<W, H>;
         friend class std::hash<Board>;
+        friend class FeatureCache<W, H>;
         static const std::size_t w = W;
         static const std::size_t h = H;
+        class Journal;
     private:
-        std::queue<PointType> placeHistory_;
+        // Stones of a group form a circular list through nextStone_, starting from head of the group.
+        // Entries of empty points are meaningless.
+        std::array<PointType, W * H> nextStone_;
+        // Last MAX_HISTORY_LENGTH moves in a ring buffer, oldest at placeHistoryBegin_
+        std::array<PointType, MAX_HISTORY_LENGTH> placeHistory_;
+        std::size_t placeHistoryBegin_ = 0, placeHistorySize_ = 0;
         PointType lastMovePoint = {0, 0};
         PointType koPoint = {-1, -1}; // -1, -1 if none
         Player koPlayer = Player::B;
-
-        std::vector< std::pair<GroupConstIterator, GroupIterator> >
-        getMapFromOldItToNewIt(GroupListType &newList,
-                               const GroupListType &oldList)
+        // Points where getPosStatus() is OK, superko aside, indexed by Player.
+        // Only points whose neighbourhood a move changes are checked again.
+        std::array<PointSetType, 2> legal_;
+        // Points of each PointState, kept in step with cells_
+        std::array<BitboardType, 3> planes_;
+        // Points whose features may have been changed by the last place(): stones, liberties or size of their group,
+        // eye shape, turns since played or ko. Only valid if lastChangedValid_, i.e. change tracking was on
+        // during the last place().
+        PointSetType lastChanged_;
+        bool trackChanges_ = true;
+        bool lastChangedValid_ = false;
+        // PatternCode of every vertex of PaddedLayout, updated around every point whose state or atari status changes.
+        // Entries of border vertices are meaningless.
+        std::array<std::uint32_t, LayoutType::SIZE> patterns_;
+        // Groups with 1 or 2 liberties, in 4 lists indexed by lowLibertyList(), in no particular order.
+        // Each listed group has its entry in lowLiberties_, indexed by GroupId.
+        struct LowLibertyEntry
         {
-            assert(newList.size() == oldList.size());
-            std::vector< std::pair<GroupConstIterator, GroupIterator>> vmap;
-            vmap.reserve(32);
-
-            auto it_new = newList.begin();
-            auto it_old = oldList.cbegin();
-            vmap.push_back(std::make_pair(oldList.cend(), newList.end()));
-            for(; it_new != newList.end() && it_old != oldList.end(); ++it_new, ++it_old)
-            {
-                vmap.push_back(std::make_pair(it_old, it_new));
-            }
-            return vmap;
+            std::uint16_t list, index; // where the group is listed. list is NOT_LISTED if it isn't
+            std::array<PointType, 2> liberties; // (-1, -1) for the second liberty of a group in atari
         };
+        static const std::uint16_t NOT_LISTED = 4;
+        std::array<std::array<GroupId, W * H>, 4> lowLibertyGroups_;
+        std::array<std::size_t, 4> lowLibertyCnt_;
+        std::array<LowLibertyEntry, W * H + 1> lowLiberties_;
+
     public:
 
         Board()
         {
-        }
-
-        Board(const Board &other):
-                boardGrid_(other.boardGrid_),
-                groupNodeList_(other.groupNodeList_),
-                posGroup_(other.posGroup_, getMapFromOldItToNewIt(groupNodeList_, other.groupNodeList_)),
-                placeHistory_(other.placeHistory_),
-                lastStateHash_(other.lastStateHash_),
-                curStateHash_(other.curStateHash_),
-                step_(other.step_),
-                lastMovePoint(other.lastMovePoint),
-                koPoint(other.koPoint),
-                koPlayer(other.koPlayer)
-        {
-        }
-
-        Board& operator=(const Board &other)
-        {
-            if (this != &other)
-            {
-                boardGrid_ = other.boardGrid_;
-                groupNodeList_ = other.groupNodeList_;
-                posGroup_ = decltype(posGroup_)
-                            (other.posGroup_, getMapFromOldItToNewIt(groupNodeList_, other.groupNodeList_));
-                placeHistory_ = other.placeHistory_;
-                lastStateHash_ = other.lastStateHash_;
-                curStateHash_ = other.curStateHash_;
-                step_ = other.step_;
-                lastMovePoint = other.lastMovePoint;
-                koPoint = other.koPoint;
-                koPlayer = other.koPlayer;
-            }
-            return *this;
+            fillCells();
+            resetLegal();
+            resetLowLiberty();
         }
 
         void clear()
         {
-            groupNodeList_.clear();
-            posGroup_.fill(groupNodeList_.end());
+            groups_.clear();
+            posGroup_.fill(NO_GROUP);
 
-            std::queue<PointType> empty;
-            std::swap(placeHistory_, empty);
+            placeHistoryBegin_ = placeHistorySize_ = 0;
 
-            boardGrid_.clear();
+            fillCells();
             lastStateHash_ = INIT_LASTSTATEHASH;
             curStateHash_ = INIT_CURSTATEHASH;
+            zobristHash_ = 0;
+            superkoHistory_.clear();
+            if (superko_)
+                superkoHistory_.insert(zobristHash_);
             step_ = 0;
             lastMovePoint.x = 0; lastMovePoint.y = 0;
+            koPoint = PointType(-1, -1);
+            resetLegal();
+            resetLowLiberty();
+            lastChangedValid_ = false;
         }
 
         // Returns color of a point
         PointState getPointState(PointType p) const
         {
-            return boardGrid_.get(p);
+            return cells_[LayoutType::vertex(p)];
         }
-        // Returns pointer to group of a point. NULL if there is no piece
+        // 3x3 pattern around p, see PatternCode. O(1)
+        std::uint32_t getPatternCode(PointType p) const
+        {
+            return patterns_[LayoutType::vertex(p)];
+        }
+        // Returns iterator to group of a point. groupEnd() if there is no piece
         GroupConstIterator getPointGroup(PointType p) const
         {
-            return posGroup_.get(p);
+            return groups_.iteratorOf(posGroup_.get(p));
         }
         // Return a copy of placeHistory_
         std::queue<PointType> getHistoryCopy() const {
-            return placeHistory_;
+            std::queue<PointType> history;
+            for (std::size_t i = 0; i < placeHistorySize_; ++i)
+                history.push(placeHistory_[(placeHistoryBegin_ + i) % MAX_HISTORY_LENGTH]);
+            return history;
         }
         std::size_t getStep() const
         {
             return step_;
         }
+        // Zobrist hash of stones on board only. Same stones give same hash regardless of move order
+        std::uint64_t getPositionHash() const
+        {
+            return zobristHash_;
+        }
+        // Zobrist hash of stones, side to move and simple ko point (if it forbids nextPlayer).
+        // Suitable as a transposition table key
+        std::uint64_t getSituationHash(Player nextPlayer) const
+        {
+            std::uint64_t hash = zobristHash_ ^ ZobristType::playerKey(nextPlayer);
+            if (koPoint != PointType(-1, -1) && koPlayer == nextPlayer)
+                hash ^= ZobristType::koKey(koPoint);
+            return hash;
+        }
+        // Enable/disable positional superko. When enabled, every position from now on is remembered,
+        // and getPosStatus() reports SUPERKO for moves that would recreate one of them.
+        void setSuperko(bool enabled)
+        {
+            superko_ = enabled;
+            superkoHistory_.clear();
+            if (enabled)
+                superkoHistory_.insert(zobristHash_);
+        }
+        bool isSuperkoEnabled() const
+        {
+            return superko_;
+        }
+        // Enable/disable tracking of points whose features each move changes, which FeatureCache needs to
+        // update incrementally. On by default. Turning it off makes place() cheaper, e.g. for playouts.
+        void setChangeTracking(bool enabled)
+        {
+            trackChanges_ = enabled;
+        }
+        bool isChangeTrackingEnabled() const
+        {
+            return trackChanges_;
+        }
+        // Whether placing a piece of player at p would recreate a remembered position. p must be a legal move
+        // other than that. Always false if superko is disabled.
+        bool isSuperko(PointType p, Player player) const;
         // place a piece on the board. State will be changed
         void place(PointType p, Player player);
+        // Same as place(), but also records how to revert this move onto journal
+        void place(PointType p, Player player, Journal &journal);
+        // Revert the last move recorded in journal. The board must not have been changed by other means since then.
+        void undo(Journal &journal);
 
         double getPointScore(PointType p, Player player) const;
 
@@ -174,7 +255,8 @@ namespace board
             NOCHANGE, // The piece to place is immediately taken away, and no change does it make to board
             KO, // Violates the rule of Ko
             NOTEMPTY, // The place is not empty
-            SUICIDE // The piece doesn't survive after place
+            SUICIDE, // The piece doesn't survive after place
+            SUPERKO // Recreates an earlier position. Only when superko is enabled
         };
         // Whether it is legal/why it is illegal to place a piece of player at p. State will not be changed.
         PositionStatus getPosStatus(PointType p, Player player) const;
@@ -182,34 +264,146 @@ namespace board
         std::vector<PointType> getAllValidPosition(Player player) const
         {
             std::vector<PointType> ans;
-            for (std::size_t i=0; i<W; ++i)
-                for (std::size_t j=0; j<H; ++j)
-                {
-                    bool temp_disable_log = (int)logger->level() == (int)spdlog::level::trace;
-                    if (temp_disable_log)
-                        logger->set_level(spdlog::level::debug);
-                    PositionStatus status = getPosStatus(PointType(i, j), player);
-                    if (temp_disable_log)
-                        logger->set_level(spdlog::level::trace);
-                    if (status == PositionStatus::OK) {
-                        ans.push_back(PointType(i, j));
-                    } else {
-                        logger->trace("Illegal move at ({}, {}): state: {}", i, j, (int)status);
-                    }
-                }
+            ans.reserve(legal_[static_cast<std::size_t>(player)].count());
+            legal_[static_cast<std::size_t>(player)].forEach([&](PointType p) {
+                if (!superko_ || !isSuperko(p, player))
+                    ans.push_back(p);
+            });
             return ans;
         }
-        // Returns first node(may be empty) of GroupNode link list
+        // Points where getPosStatus(p, player) is OK, except that superko is not considered.
+        // Kept up to date by every move, so reading it costs nothing.
+        const PointSetType &getLegalSet(Player player) const
+        {
+            return legal_[static_cast<std::size_t>(player)];
+        }
+        // Size of getLegalSet(player). O(1)
+        std::size_t getLegalCount(Player player) const
+        {
+            return legal_[static_cast<std::size_t>(player)].count();
+        }
+        // The n-th point of getLegalSet(player), in order of x * W + y. n must be less than getLegalCount(player)
+        PointType getNthLegal(Player player, std::size_t n) const
+        {
+            return legal_[static_cast<std::size_t>(player)].nth(n);
+        }
+        // Groups of player in atari, and with exactly 2 liberties. Kept up to date by every move, so they cost
+        // nothing to count and time proportional to their number to list. Listed in no particular order.
+        std::size_t getAtariGroupCount(Player player) const
+        {
+            return lowLibertyCnt_[lowLibertyList(player, 1)];
+        }
+        std::size_t getTwoLibertyGroupCount(Player player) const
+        {
+            return lowLibertyCnt_[lowLibertyList(player, 2)];
+        }
+        // Call f(group, liberty) for every group of player in atari. f must not change the board
+        template<typename FT>
+        void forEachAtariGroup(Player player, FT f) const
+        {
+            std::size_t list = lowLibertyList(player, 1);
+            for (std::size_t i = 0; i < lowLibertyCnt_[list]; ++i)
+            {
+                GroupId group = lowLibertyGroups_[list][i];
+                f(groups_.iteratorOf(group), lowLiberties_[group].liberties[0]);
+            }
+        }
+        // Call f(group, liberty1, liberty2) for every group of player with 2 liberties. f must not change the board
+        template<typename FT>
+        void forEachTwoLibertyGroup(Player player, FT f) const
+        {
+            std::size_t list = lowLibertyList(player, 2);
+            for (std::size_t i = 0; i < lowLibertyCnt_[list]; ++i)
+            {
+                GroupId group = lowLibertyGroups_[list][i];
+                f(groups_.iteratorOf(group), lowLiberties_[group].liberties[0], lowLiberties_[group].liberties[1]);
+            }
+        }
+        // Liberties of a group with at most 2 of them, (-1, -1) for any missing. O(1)
+        std::array<PointType, 2> getLowLiberties(GroupConstIterator group) const
+        {
+            if (group == groupEnd() || lowLiberties_[group.id()].list == NOT_LISTED)
+                return {{PointType(-1, -1), PointType(-1, -1)}};
+            return lowLiberties_[group.id()].liberties;
+        }
+        // Points in state s, as a bitboard
+        const BitboardType &getPlane(PointState s) const
+        {
+            return planes_[static_cast<std::size_t>(s)];
+        }
+        // The following are computed on demand from the planes by a few bitboard operations,
+        // for callers which need whole sets of points rather than group summaries.
+        // Stones of the group at p. p must not be empty
+        BitboardType getGroupStones(PointType p) const
+        {
+            BitboardType seed;
+            seed.set(p);
+            return BitboardType::floodFill(seed, getPlane(getPointState(p)));
+        }
+        // Liberties of the group at p. p must not be empty
+        BitboardType getGroupLibertySet(PointType p) const
+        {
+            return getGroupStones(p).neighbours() & getPlane(PointState::NA);
+        }
+        // Opponent stones taken away if player places at empty point p
+        BitboardType getCaptureSet(PointType p, Player player) const;
+        // Empty points connected to empty point p
+        BitboardType getEmptyRegion(PointType p) const
+        {
+            BitboardType seed;
+            seed.set(p);
+            return BitboardType::floodFill(seed, getPlane(PointState::NA));
+        }
+        // Tromp-Taylor area of player: its stones, and empty points from which only its stones are reached
+        // through empty points. Two flood fills, however many empty regions there are.
+        BitboardType getArea(Player player) const
+        {
+            return getPlane(getPointStateFromPlayer(player)) | (getReach(player) - getReach(getOpponentPlayer(player)));
+        }
+        // Tromp-Taylor score: size of getArea() of black minus that of white minus komi. Positive if black wins
+        double getAreaScore(double komi) const
+        {
+            BitboardType blackReach = getReach(Player::B), whiteReach = getReach(Player::W);
+            std::size_t black = (getPlane(PointState::B) | (blackReach - whiteReach)).count(),
+                    white = (getPlane(PointState::W) | (whiteReach - blackReach)).count();
+            return static_cast<double>(black) - static_cast<double>(white) - komi;
+        }
+        // Area of player at the end of a playout which never fills an eye, where every empty point is eye-like:
+        // its stones, and empty points next to its stones only. Empty points touching both colours or neither
+        // belong to nobody. A few bitboard operations, without flood fill.
+        BitboardType getPlayoutArea(Player player) const
+        {
+            const BitboardType &ours = getPlane(getPointStateFromPlayer(player)),
+                    &theirs = getPlane(getPointStateFromPlayer(getOpponentPlayer(player)));
+            return ours | ((ours.dilate() & getPlane(PointState::NA)) - theirs.dilate());
+        }
+        // Same as getAreaScore() with getPlayoutArea()
+        double getPlayoutScore(double komi) const
+        {
+            return static_cast<double>(getPlayoutArea(Player::B).count()) -
+                   static_cast<double>(getPlayoutArea(Player::W).count()) - komi;
+        }
+        // Returns first group on board (groupEnd() if none). Groups are visited in order of id
         GroupConstIterator groupBegin() const
         {
-            return groupNodeList_.cbegin();
+            return groups_.begin();
         }
 
         GroupConstIterator groupEnd() const
         {
-            return groupNodeList_.cend();
+            return groups_.end();
+        }
+
+        // Call f(PointType) on every stone of group, in time proportional to its size. f must not change the board
+        template<typename FT>
+        void forEachStone(GroupConstIterator group, FT f) const
+        {
+            forEachStone_(group.id(), f);
         }
 
+        // The only liberty of a group in atari. (-1, -1) if group is not in atari. O(1)
+        PointType getAtariLiberty(GroupConstIterator group) const;
+
         bool isEye(PointType p, Player player) const;
         bool isSemiEye(PointType p, Player player) const;
         bool isFakeEye(PointType p, Player player) const;
@@ -220,182 +414,747 @@ namespace board
 
         friend std::ostream& operator<< <>(std::ostream&, const Board&);
 
-        gocnn::RequestV1 generateRequestV1(Player player);
-        gocnn::RequestV2 generateRequestV2(Player player);
-        gocnn::RequestV2 generateRequestV2Bug(Player player); // Bug workaround version
+        gocnn::RequestV1 generateRequestV1(Player player) const;
+        gocnn::RequestV2 generateRequestV2(Player player) const;
+        gocnn::RequestV2 generateRequestV2Bug(Player player) const; // Bug workaround version
+        // Same as above, but fill a message owned by caller. Capacity of its repeated fields is reused,
+        // so refilling the same message allocates nothing.
+        void generateRequestV1(Player player, gocnn::RequestV1 &reqv1) const;
+        void generateRequestV2(Player player, gocnn::RequestV2 &reqv2) const;
+        void generateRequestV2Bug(Player player, gocnn::RequestV2 &reqv2) const;
+        // Same as above, with the message allocated on arena
+        gocnn::RequestV1 *generateRequestV1(Player player, google::protobuf::Arena *arena) const;
+        gocnn::RequestV2 *generateRequestV2(Player player, google::protobuf::Arena *arena) const;
+        gocnn::RequestV2 *generateRequestV2Bug(Player player, google::protobuf::Arena *arena) const;
+
+        enum struct FeatureSet
+        {
+            V1, // Planes of RequestV1
+            V2, // Planes of RequestV2
+            V2Bug // Planes of generateRequestV2Bug()
+        };
+        enum struct FeatureLayout
+        {
+            NCHW, // out[plane][x][y]
+            NHWC // out[x][y][plane]
+        };
+        static const std::size_t FEATURE_V1_PLANES = 7, FEATURE_V2_PLANES = 39;
+        static const std::size_t FEATURE_V2_POSITION_PLANE = 38; // The only plane of V2/V2Bug which is not boolean
+        static std::size_t getFeaturePlaneCount(FeatureSet set)
+        {
+            return set == FeatureSet::V1 ? FEATURE_V1_PLANES : FEATURE_V2_PLANES;
+        }
+        // Write the features generateRequestV1/V2/V2Bug() would send, one plane per repeated field in order of field number,
+        // into out, which holds getFeaturePlaneCount(set) * W * H values. No memory is allocated.
+        // Boolean features are 0/1. Position is written as is to float, and scaled to 0..255 to uint8_t.
+        void writeFeaturePlanes(Player player, float *out, FeatureSet set = FeatureSet::V2,
+                                FeatureLayout layout = FeatureLayout::NCHW) const;
+        void writeFeaturePlanes(Player player, std::uint8_t *out, FeatureSet set = FeatureSet::V2,
+                                FeatureLayout layout = FeatureLayout::NCHW) const;
+
+        // Planes of set packed 1 bit per point, see message_v3.proto. Position is left out of V2/V2Bug
+        gocnn::RequestV3 generateRequestV3(Player player, FeatureSet set = FeatureSet::V2) const;
+        // Unpack req into out, as writeFeaturePlanes() would write to float in NCHW, position included
+        static void decodeRequestV3(const gocnn::RequestV3 &req, float *out);
+        // Pack W * H possibilities of a policy output
+        static gocnn::ResponseV3 encodeResponseV3(const float *possibility, gocnn::ResponseV3::Encoding encoding);
+        // Unpack resp into W * H possibilities
+        static void decodeResponseV3(const gocnn::ResponseV3 &resp, float *possibility);
+        // Planes of set of every (board, player to move) in positions, packed as generateRequestV3() does, one after another
+        static gocnn::RequestBatch generateRequestBatch(const std::vector<std::pair<const Board *, Player>> &positions,
+                                                        FeatureSet set = FeatureSet::V2);
+        // Unpack the i-th position of req, as decodeRequestV3() does
+        static void decodeRequestBatch(const gocnn::RequestBatch &req, std::size_t i, float *out);
+        // Pack batchSize * W * H possibilities, W * H for each position of a RequestBatch in order
+        static gocnn::ResponseBatch encodeResponseBatch(const float *possibility, std::size_t batchSize,
+                                                        gocnn::ResponseV3::Encoding encoding);
+        // Unpack W * H possibilities of the i-th position of resp
+        static void decodeResponseBatch(const gocnn::ResponseBatch &resp, std::size_t i, float *possibility);
+
+    private:
+        // Everything needed to revert a single place()
+        struct UndoEntry
+        {
+            PointType point;
+            GroupId newGroup;
+            std::size_t step;
+            std::size_t lastStateHash, curStateHash;
+            std::uint64_t zobristHash;
+            typename SuperkoHistoryType::InsertRecord superkoRecord; // what the new position did to superkoHistory_
+            PointType lastMovePoint;
+            PointType koPoint;
+            Player koPlayer;
+            bool historyPopped;
+            PointType historyFront; // the oldest move, overwritten by this one when history is full
+            std::vector< std::pair<PointType, PointState> > gridChanges;
+            std::vector< std::pair<PointType, PointType> > stoneLinkChanges; // old nextStone_ of points
+            typename PosGroupType::ChangeLog posGroupChanges;
+            std::vector< std::pair<GroupId, GroupNodeType> > groupChanges; // old value of groups modified or freed
+            std::vector<GroupId> freedGroups; // in order of free()
+            std::size_t freedBeforeNew; // how many of freedGroups are captured before newGroup is allocated
+            std::array<PointSetType, 2> legal;
+            PointSetType lastChanged;
+            bool lastChangedValid;
+            std::vector< std::pair<std::size_t, std::uint32_t> > patternChanges; // old patterns_ of vertices
+        };
+        // Points emptied and groups whose liberties changed during one move, around which legality is checked again
+        struct TouchedSet
+        {
+            std::array<PointType, W * H> points;
+            std::size_t pointCnt = 0;
+            std::array<GroupId, W * H> groups;
+            std::array<std::size_t, W * H> oldLiberties; // liberty of groups[i] before the move
+            std::size_t groupCnt = 0;
+            // Group of the stone placed, and liberties before the move of our groups merged into it
+            GroupId newGroup = NO_GROUP;
+            std::array<std::size_t, 4> mergedLiberties;
+            std::size_t mergedCnt = 0;
+
+            void addPoint(PointType p)
+            {
+                points[pointCnt++] = p;
+            }
+            // To be called before liberty of group changes. Only the first call for a group counts,
+            // and the liberty it gave is returned
+            std::size_t addGroup(GroupId group, std::size_t oldLiberty)
+            {
+                std::size_t i = std::find(groups.begin(), groups.begin() + groupCnt, group) - groups.begin();
+                if (i == groupCnt)
+                {
+                    oldLiberties[groupCnt] = oldLiberty;
+                    groups[groupCnt++] = group;
+                }
+                return oldLiberties[i];
+            }
+        };
+    public:
+        // A stack of moves made by place(p, player, journal), to be reverted by undo()
+        // Entries are kept after undo() so that their buffers can be reused by the next place()
+        class Journal
+        {
+            friend class Board;
+            std::vector<UndoEntry> entries_;
+            std::size_t size_ = 0;
 
+            UndoEntry &push()
+            {
+                if (size_ == entries_.size())
+                    entries_.emplace_back();
+                UndoEntry &entry = entries_[size_++];
+                entry.gridChanges.clear();
+                entry.stoneLinkChanges.clear();
+                entry.posGroupChanges.clear();
+                entry.groupChanges.clear();
+                entry.freedGroups.clear();
+                entry.patternChanges.clear();
+                return entry;
+            }
+            UndoEntry &back()
+            {
+                return entries_[size_ - 1];
+            }
+        public:
+            std::size_t size() const
+            {
+                return size_;
+            }
+            bool empty() const
+            {
+                return size_ == 0;
+            }
+            void clear()
+            {
+                entries_.clear();
+                size_ = 0;
+            }
+        };
     private:
+        // Empty points reached from stones of player through empty points
+        BitboardType getReach(Player player) const
+        {
+            const BitboardType &empty = getPlane(PointState::NA);
+            return BitboardType::floodFill(getPlane(getPointStateFromPlayer(player)).dilate() & empty, empty);
+        }
         // Internal use only
-        GroupIterator getPointGroup_(PointType p) const
+        GroupId getPointGroup_(PointType p) const
         {
             return posGroup_.get(p);
         }
+        static std::size_t pointToIndex(PointType p)
+        {
+            return p.x * W + p.y;
+        }
+        void fillCells()
+        {
+            for (std::size_t v = 0; v < LayoutType::SIZE; ++v)
+                cells_[v] = LayoutType::isBorder(v) ? LayoutType::BORDER : PointState::NA;
+            planes_[static_cast<std::size_t>(PointState::NA)] = BitboardType::full();
+            planes_[static_cast<std::size_t>(PointState::W)].clear();
+            planes_[static_cast<std::size_t>(PointState::B)].clear();
+            for (std::size_t v = 0; v < LayoutType::SIZE; ++v)
+            {
+                std::uint32_t code = 0;
+                if (!LayoutType::isBorder(v))
+                    for (std::size_t i = 0; i < 4; ++i)
+                        code |= static_cast<std::uint32_t>(cells_[v + LayoutType::ADJ[i]]) << (2 * i) |
+                                static_cast<std::uint32_t>(cells_[v + LayoutType::DIAG[i]]) << (2 * (i + 4));
+                patterns_[v] = code;
+            }
+        }
+        void setCell(PointType p, PointState state)
+        {
+            PointState &cell = cells_[LayoutType::vertex(p)];
+            planes_[static_cast<std::size_t>(cell)].reset(p);
+            planes_[static_cast<std::size_t>(state)].set(p);
+            cell = state;
+        }
+        // Calls f(adjP, state) for the 4 neighbours of p, in the order of GridPoint::for_each_adjacent().
+        // A neighbour off board is passed too, with state LayoutType::BORDER, and must not be looked up.
+        template<typename FT>
+        void forEachAdjacent_(PointType p, FT f) const
+        {
+            std::size_t v = LayoutType::vertex(p);
+            for (std::size_t i = 0; i < 4; ++i)
+                f(PointType(p.x + LayoutType::ADJ_DX[i], p.y + LayoutType::ADJ_DY[i]), cells_[v + LayoutType::ADJ[i]]);
+        }
+        // Same as forEachAdjacent_(), for the 4 diagonal neighbours in the order of GridPoint::for_each_diag()
+        template<typename FT>
+        void forEachDiag_(PointType p, FT f) const
+        {
+            std::size_t v = LayoutType::vertex(p);
+            for (std::size_t i = 0; i < 4; ++i)
+                f(PointType(p.x + LayoutType::DIAG_DX[i], p.y + LayoutType::DIAG_DY[i]), cells_[v + LayoutType::DIAG[i]]);
+        }
+        template<typename FT>
+        void forEachStone_(GroupId group, FT f) const
+        {
+            PointType head = groups_[group].getHead(), p = head;
+            do
+            {
+                PointType next = nextStone_[pointToIndex(p)];
+                f(p);
+                p = next;
+            } while (p != head);
+        }
         PositionStatus getPosStatusAndPlace(PointType p, Player player);
-        void removeGroup(GroupIterator group);
-        void removeGroupFromPos(PointType p);
-        void mergeGroupAt(PointType thisPoint, PointType otherPoint);
-        std::vector<GroupIterator> getAdjacentGroups(PointType p);
-        static inline bool GroupIteratorLess(const GroupIterator& it1, const GroupIterator& it2)
+        // Values which depend only on where a point is, computed once per board size and indexed by pointToIndex()
+        struct PointTables
+        {
+            std::array<float, W * H> position; // position plane of RequestV2
+            std::array<bool, W * H> border;
+            std::array<double, W * H> positionScore; // position_score of getPointScore()
+        };
+        static const PointTables &pointTables()
+        {
+            static const PointTables tables = [] {
+                PointTables t;
+                PointType::for_all([&](PointType p) {
+                    std::size_t idx = pointToIndex(p);
+                    t.position[idx] = static_cast<float>(exp(-0.5 * (pow((double)p.x - (double)(H - 1) / 2.0, 2) +
+                                                                      pow((double)p.y - (double)(W - 1) / 2.0, 2))));
+                    t.border[idx] = p.is_left() || p.is_top() || p.is_right() || p.is_bottom();
+                    t.positionScore[idx] = 100 * (1 - std::min(std::min(abs(p.x - 3.0), abs(p.x - 15.0)),
+                                                               std::min(abs(p.y - 3.0), abs(p.y - 15.0))) / 7.0);
+                });
+                return t;
+            }();
+            return tables;
+        }
+        static const std::size_t PACKED_PLANE_BYTES = (W * H + 7) / 8;
+        static std::size_t getPackedPlaneCount(FeatureSet set)
+        {
+            return set == FeatureSet::V1 ? FEATURE_V1_PLANES : FEATURE_V2_PLANES - 1; // no position
+        }
+        static std::size_t getPossibilityBytes(gocnn::ResponseV3::Encoding encoding)
         {
-            return &(*it1) < &(*it2);
+            return encoding == gocnn::ResponseV3::UINT8 ? 1 : 2;
         }
+        static gocnn::FeatureSet toMessageFeatureSet(FeatureSet set);
+        // Write getPackedPlaneCount(set) * PACKED_PLANE_BYTES bytes to out
+        void packFeatures(Player player, FeatureSet set, char *out) const;
+        static void unpackFeatures(const char *packed, std::size_t planeCnt, bool withPosition, float *out);
+        // Write W * H * getPossibilityBytes(encoding) bytes to out
+        static void packPossibility(const float *possibility, gocnn::ResponseV3::Encoding encoding, char *out);
+        static void unpackPossibility(const char *packed, gocnn::ResponseV3::Encoding encoding, float *possibility);
+        void fillRequestV2(Player player, FeatureSet set, gocnn::RequestV2 &reqv2) const;
+        using HistoryArray = std::array<PointType, MAX_HISTORY_LENGTH>;
+        // Moves which turns_since planes of set show, most recent first. Returns how many
+        std::size_t getFeatureHistory(FeatureSet set, HistoryArray &history) const;
+        // Call f(plane, value) for every non-zero feature of set at p
+        template<typename FT>
+        void forEachPointFeature(Player player, FeatureSet set, PointType p,
+                                 const HistoryArray &history, std::size_t historySize, FT f) const;
+        // The same for FeatureSet::V1, whose planes are all below FEATURE_V1_PLANES
+        template<typename FT>
+        void forEachPointFeatureV1(Player player, PointType p, FT f) const;
+        // Call f(plane, x * W + y, value) for every non-zero feature of set
+        template<typename FT>
+        void forEachFeature(Player player, FeatureSet set, FT f) const;
+        template<typename T>
+        void writeFeaturePlanesImpl(Player player, T *out, FeatureSet set, FeatureLayout layout) const;
+        // getPosStatus() without superko
+        PositionStatus getRulePosStatus(PointType p, Player player) const;
+        void refreshLegal(PointType p);
+        void resetLegal();
+        void updateLegal(PointType p, const TouchedSet &touched, PointType oldKoPoint);
+        void setPattern(std::size_t v, std::uint32_t code, UndoEntry *undo);
+        // Set atari bits of patterns of neighbours of p, which must be a stone
+        void setAtariBits(PointType p, bool inAtari, UndoEntry *undo);
+        void updatePatterns(PointType p, const TouchedSet &touched, UndoEntry *undo);
+        static std::size_t lowLibertyList(Player player, std::size_t liberty)
+        {
+            return static_cast<std::size_t>(player) * 2 + liberty - 1;
+        }
+        void resetLowLiberty();
+        // List group by its current liberties, finding them by walking its stones if there are at most 2
+        void refreshLowLiberty(GroupId group);
+        // A point together with its 8 neighbours, indexed by pointToIndex()
+        static const std::array<PointSetType, W * H> &getNeighbourhoods()
+        {
+            static const std::array<PointSetType, W * H> neighbourhoods = [] {
+                std::array<PointSetType, W * H> n;
+                PointType::for_all([&](PointType p) {
+                    PointSetType &set = n[pointToIndex(p)];
+                    set.set(p, true);
+                    p.for_each_adjacent([&](PointType adjP) {
+                        set.set(adjP, true);
+                    });
+                    p.for_each_diag([&](PointType diagP) {
+                        set.set(diagP, true);
+                    });
+                });
+                return n;
+            }();
+            return neighbourhoods;
+        }
+        void markChanged(PointType p, const TouchedSet &touched, PointType oldKoPoint);
+        void placeImpl(PointType p, Player player, UndoEntry *undo);
+        void setGrid(PointType p, PointState state, UndoEntry *undo);
+        void setNextStone(PointType p, PointType next, UndoEntry *undo);
+        void saveGroup(GroupId group, UndoEntry *undo);
+        void addGroupLiberty(GroupId group, UndoEntry *undo);
+        void removeGroupLiberty(GroupId group, UndoEntry *undo);
+        void eraseGroup(GroupId group, UndoEntry *undo);
+        void removeGroup(GroupId group, UndoEntry *undo, TouchedSet &touched);
+        std::size_t countSharedLiberties(GroupId group, GroupId other) const;
+        void mergeGroupAt(PointType thisPoint, PointType otherPoint, UndoEntry *undo);
     };
 
     template<std::size_t W, std::size_t H>
-    auto Board<W, H>::getAdjacentGroups(PointType p) -> std::vector<GroupIterator>
+    void Board<W, H>::setGrid(PointType p, PointState state, UndoEntry *undo)
     {
-        std::vector<GroupIterator> adjGroups;
-        adjGroups.reserve(4);
-        p.for_each_adjacent([&](PointType adjP) {
-            GroupIterator group = getPointGroup_(adjP);
-            if (group != groupNodeList_.end())
-                adjGroups.push_back(group);
-        });
-        // remove Duplicated groups
-        std::sort(adjGroups.begin(), adjGroups.end(), Board::GroupIteratorLess);
-        auto newEnd = std::unique(adjGroups.begin(), adjGroups.end());
-        adjGroups.erase(newEnd, adjGroups.end());
-        return adjGroups;
+        PointState oldState = getPointState(p);
+        if (undo)
+            undo->gridChanges.push_back(std::make_pair(p, oldState));
+        zobristHash_ ^= ZobristType::stoneKey(p, oldState) ^ ZobristType::stoneKey(p, state);
+        setCell(p, state);
+        // p is slot i ^ 2 of its i-th adjacent neighbour, and slot 4 + (3 - i) of its i-th diagonal one.
+        // A stone placed or removed is not in atari yet, which updatePatterns() sees to afterwards.
+        std::size_t v = LayoutType::vertex(p);
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            std::size_t adjV = v + LayoutType::ADJ[i], diagV = v + LayoutType::DIAG[i];
+            std::size_t adjSlot = i ^ 2, diagSlot = 4 + (3 - i);
+            std::uint32_t adjMask = 3u << (2 * adjSlot) | 1u << (PatternCode::ATARI_SHIFT + adjSlot),
+                    diagMask = 3u << (2 * diagSlot);
+            if (cells_[adjV] != LayoutType::BORDER)
+                setPattern(adjV, (patterns_[adjV] & ~adjMask) | static_cast<std::uint32_t>(state) << (2 * adjSlot),
+                           undo);
+            if (cells_[diagV] != LayoutType::BORDER)
+                setPattern(diagV, (patterns_[diagV] & ~diagMask) | static_cast<std::uint32_t>(state) << (2 * diagSlot),
+                           undo);
+        }
     }
 
     template<std::size_t W, std::size_t H>
-    void Board<W, H>::removeGroup(GroupIterator group)
+    void Board<W, H>::resetLowLiberty()
     {
-        std::vector<PointType> point_to_remove;
-        point_to_remove.reserve(W * H);
-        PointType::for_all([&](PointType p) {
-            if (getPointGroup(p) == group)
-            {
-                std::vector<GroupIterator> adjGroups = getAdjacentGroups(p);
-                std::for_each(adjGroups.begin(), adjGroups.end(), [&](GroupIterator adjGroup) {
-                    if (adjGroup != group) adjGroup->setLiberty(p, true);
-                });
-                boardGrid_.set(p, PointState::NA);
-                // posGroup_.set(p, groupNodeList_.end());
-                // cannot delete here, since union-set would stuck into inconsistent state
-                point_to_remove.push_back(p);
-            }
-        });
-        std::for_each(point_to_remove.begin(), point_to_remove.end(), [&](PointType p){
-            posGroup_.set(p, groupNodeList_.end());
-        });
-        groupNodeList_.erase(group);
+        lowLibertyCnt_.fill(0);
+        for (LowLibertyEntry &entry: lowLiberties_)
+            entry.list = NOT_LISTED;
     }
 
     template<std::size_t W, std::size_t H>
-    void Board<W, H>::removeGroupFromPos(PointType p)
+    void Board<W, H>::refreshLowLiberty(GroupId group)
     {
-        GroupIterator group = getPointGroup_(p);
-        std::vector<PointType> point_to_remove;
-        point_to_remove.reserve(W * H);
+        LowLibertyEntry &entry = lowLiberties_[group];
+        if (entry.list != NOT_LISTED)
+        {
+            // Move the last group of the list into its place
+            GroupId last = lowLibertyGroups_[entry.list][--lowLibertyCnt_[entry.list]];
+            lowLibertyGroups_[entry.list][entry.index] = last;
+            lowLiberties_[last].index = entry.index;
+            entry.list = NOT_LISTED;
+        }
+        const GroupNodeType &node = groups_[group];
+        std::size_t liberty = node.getLiberty();
+        if (node.getStoneCnt() == 0 || liberty == 0 || liberty > 2)
+            return;
+        entry.list = static_cast<std::uint16_t>(lowLibertyList(node.getPlayer(), liberty));
+        entry.index = static_cast<std::uint16_t>(lowLibertyCnt_[entry.list]);
+        lowLibertyGroups_[entry.list][lowLibertyCnt_[entry.list]++] = group;
+
+        entry.liberties = {{PointType(-1, -1), PointType(-1, -1)}};
+        std::size_t found = 0;
+        PointType head = node.getHead(), p = head;
+        do
+        {
+            forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+                if (adjState == PointState::NA && found < liberty && (found == 0 || entry.liberties[0] != adjP))
+                    entry.liberties[found++] = adjP;
+            });
+            p = nextStone_[pointToIndex(p)];
+        } while (found < liberty && p != head);
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::setPattern(std::size_t v, std::uint32_t code, UndoEntry *undo)
+    {
+        if (undo)
+            undo->patternChanges.push_back(std::make_pair(v, patterns_[v]));
+        patterns_[v] = code;
+    }
 
-        std::queue<PointType> point_to_visit;
-        bool visited[W * H] {};
-        point_to_visit.push(p);
-        while (!point_to_visit.empty())
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::setAtariBits(PointType p, bool inAtari, UndoEntry *undo)
+    {
+        std::size_t v = LayoutType::vertex(p);
+        for (std::size_t i = 0; i < 4; ++i)
         {
-            PointType p = point_to_visit.front();
-            point_to_visit.pop();
+            std::size_t adjV = v + LayoutType::ADJ[i];
+            std::uint32_t bit = 1u << (PatternCode::ATARI_SHIFT + (i ^ 2));
+            if (cells_[adjV] != LayoutType::BORDER && ((patterns_[adjV] & bit) != 0) != inAtari)
+                setPattern(adjV, patterns_[adjV] ^ bit, undo);
+        }
+    }
 
-            p.for_each_adjacent([&](PointType adjP) {
-                GroupIterator adjGroup = getPointGroup_(adjP);
-                if (adjGroup == group)
-                {
-                    if (!visited[adjP.x * H + adjP.y])
-                    {
-                        point_to_visit.push(adjP);
-                        visited[adjP.x * H + adjP.y] = true;
-                    }
-                } else if (adjGroup != groupNodeList_.end())
+    // Colours are updated by setGrid() as they change. Atari bits change around groups which went into or out of
+    // atari, as in updateLegal()
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::updatePatterns(PointType p, const TouchedSet &touched, UndoEntry *undo)
+    {
+        auto setGroupAtariBits = [&](GroupId group) {
+            bool inAtari = groups_[group].isInAtari();
+            forEachStone_(group, [&](PointType stone) {
+                setAtariBits(stone, inAtari, undo);
+            });
+        };
+        for (std::size_t i = 0; i < touched.groupCnt; ++i)
+        {
+            GroupId group = touched.groups[i];
+            if (group == touched.newGroup || groups_[group].getStoneCnt() == 0)
+                continue;
+            if ((touched.oldLiberties[i] == 1) != groups_[group].isInAtari())
+                setGroupAtariBits(group);
+        }
+        if (groups_[touched.newGroup].getStoneCnt() != 0)
+        {
+            bool inAtari = groups_[touched.newGroup].isInAtari();
+            bool changed = false;
+            for (std::size_t i = 0; i < touched.mergedCnt; ++i)
+                changed = changed || (touched.mergedLiberties[i] == 1) != inAtari;
+            if (changed)
+                setGroupAtariBits(touched.newGroup);
+            else
+                setAtariBits(p, inAtari, undo);
+        }
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::setNextStone(PointType p, PointType next, UndoEntry *undo)
+    {
+        if (undo)
+            undo->stoneLinkChanges.push_back(std::make_pair(p, nextStone_[pointToIndex(p)]));
+        nextStone_[pointToIndex(p)] = next;
+    }
+
+    // Remember value of group before it is changed for the first time in this move
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::saveGroup(GroupId group, UndoEntry *undo)
+    {
+        if (undo && group != undo->newGroup &&
+                std::find_if(undo->groupChanges.cbegin(), undo->groupChanges.cend(),
+                             [&](const std::pair<GroupId, GroupNodeType> &item) {
+                                 return item.first == group;
+                             }) == undo->groupChanges.cend())
+            undo->groupChanges.push_back(std::make_pair(group, groups_[group]));
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::addGroupLiberty(GroupId group, UndoEntry *undo)
+    {
+        saveGroup(group, undo);
+        groups_[group].addLiberty();
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::removeGroupLiberty(GroupId group, UndoEntry *undo)
+    {
+        saveGroup(group, undo);
+        groups_[group].removeLiberty();
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::eraseGroup(GroupId group, UndoEntry *undo)
+    {
+        saveGroup(group, undo);
+        if (undo)
+            undo->freedGroups.push_back(group);
+        groups_.free(group);
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::removeGroup(GroupId group, UndoEntry *undo, TouchedSet &touched)
+    {
+        // Stones adjacent to this group but of another color belong to other groups, which gain a liberty
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(groups_[group].getPlayer()));
+        forEachStone_(group, [&](PointType p) {
+            // A group next to p through several stones gains p once
+            std::array<GroupId, 4> gained;
+            std::size_t gainedCnt = 0;
+            forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+                if (adjState == oppoState)
                 {
-                    adjGroup->setLiberty(p, true);
+                    GroupId adjGroup = getPointGroup_(adjP);
+                    if (std::find(gained.begin(), gained.begin() + gainedCnt, adjGroup) != gained.begin() + gainedCnt)
+                        return;
+                    gained[gainedCnt++] = adjGroup;
+                    touched.addGroup(adjGroup, groups_[adjGroup].getLiberty());
+                    addGroupLiberty(adjGroup, undo);
                 }
             });
-
-            boardGrid_.set(p, PointState::NA);
-            // posGroup_.set(p, groupNodeList_.end());
-            // cannot delete here, since union-set would stuck into inconsistent state
-            point_to_remove.push_back(p);
-        }
-        std::for_each(point_to_remove.begin(), point_to_remove.end(), [&](PointType p){
-            posGroup_.set(p, groupNodeList_.end());
+            touched.addPoint(p);
+            setGrid(p, PointState::NA, undo);
+            // Only stones of this group may point to p in posGroup_, so this can be done right away
+            posGroup_.set(p, NO_GROUP, undo ? &undo->posGroupChanges : nullptr);
         });
-        groupNodeList_.erase(group);
+        eraseGroup(group, undo);
     }
 
+    // Liberties of group which other has as well, found by walking the stones of group, so it should be the smaller.
+    // Stones of group are collected first, so that only neighbours outside it need their group looked up
     template<std::size_t W, std::size_t H>
-    void Board<W, H>::mergeGroupAt(PointType thisPoint, PointType thatPoint)
+    std::size_t Board<W, H>::countSharedLiberties(GroupId group, GroupId other) const
     {
-        GroupIterator thisGroup = getPointGroup_(thisPoint), thatGroup = getPointGroup_(thatPoint);
-        posGroup_.merge(thisPoint, thatPoint);
+        PointState state = getPointStateFromPlayer(groups_[group].getPlayer());
+        BitboardType stones, seen;
+        forEachStone_(group, [&](PointType stone) {
+            stones.set(stone);
+        });
+        std::size_t shared = 0;
+        forEachStone_(group, [&](PointType stone) {
+            forEachAdjacent_(stone, [&](PointType libP, PointState libState) {
+                if (libState != PointState::NA || seen.test(libP))
+                    return;
+                seen.set(libP);
+                bool byOther = false;
+                forEachAdjacent_(libP, [&](PointType adjP, PointState adjState) {
+                    byOther = byOther || (adjState == state && !stones.test(adjP) && getPointGroup_(adjP) == other);
+                });
+                shared += byOther;
+            });
+        });
+        return shared;
+    }
 
-        thisGroup->merge(*thatGroup);
-        groupNodeList_.erase(thatGroup);
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::mergeGroupAt(PointType thisPoint, PointType thatPoint, UndoEntry *undo)
+    {
+        GroupId thisGroup = getPointGroup_(thisPoint), thatGroup = getPointGroup_(thatPoint);
+        // Must be counted while stones still tell which group they belong to
+        std::size_t shared = groups_[thisGroup].getStoneCnt() <= groups_[thatGroup].getStoneCnt() ?
+                             countSharedLiberties(thisGroup, thatGroup) : countSharedLiberties(thatGroup, thisGroup);
+        posGroup_.merge(thisPoint, thatPoint, undo ? &undo->posGroupChanges : nullptr);
+
+        // Swapping successors of one stone from each circular list joins them into one
+        PointType thisNext = nextStone_[pointToIndex(thisPoint)];
+        setNextStone(thisPoint, nextStone_[pointToIndex(thatPoint)], undo);
+        setNextStone(thatPoint, thisNext, undo);
+
+        groups_[thisGroup].merge(groups_[thatGroup], shared);
+        eraseGroup(thatGroup, undo);
     }
 
     template<std::size_t W, std::size_t H>
     void Board<W,H>::place(PointType p, Player player)
     {
-        logger->trace("Place at {}, {}: {}", (int)p.x, (int)p.y, (int) player);
+        placeImpl(p, player, nullptr);
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W,H>::place(PointType p, Player player, Journal &journal)
+    {
+        if (getPointState(p) != PointState::NA)
+            throw std::runtime_error("Try to place on an non-empty point");
+
+        UndoEntry &undo = journal.push();
+        undo.point = p;
+        undo.newGroup = NO_GROUP;
+        undo.freedBeforeNew = 0;
+        undo.step = step_;
+        undo.lastStateHash = lastStateHash_;
+        undo.curStateHash = curStateHash_;
+        undo.zobristHash = zobristHash_;
+        undo.superkoRecord = typename SuperkoHistoryType::InsertRecord();
+        undo.lastMovePoint = lastMovePoint;
+        undo.koPoint = koPoint;
+        undo.koPlayer = koPlayer;
+        undo.historyPopped = placeHistorySize_ >= MAX_HISTORY_LENGTH;
+        if (undo.historyPopped)
+            undo.historyFront = placeHistory_[placeHistoryBegin_];
+        undo.legal = legal_;
+        undo.lastChanged = lastChanged_;
+        undo.lastChangedValid = lastChangedValid_;
+        placeImpl(p, player, &undo);
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W,H>::undo(Journal &journal)
+    {
+        if (journal.empty())
+            throw std::runtime_error("Try to undo with an empty journal");
+        UndoEntry &undo = journal.back();
+
+        if (undo.historyPopped)
+        {
+            placeHistoryBegin_ = (placeHistoryBegin_ + MAX_HISTORY_LENGTH - 1) % MAX_HISTORY_LENGTH;
+            placeHistory_[placeHistoryBegin_] = undo.historyFront;
+        }
+        else
+            --placeHistorySize_;
+        step_ = undo.step;
+        lastStateHash_ = undo.lastStateHash;
+        curStateHash_ = undo.curStateHash;
+        zobristHash_ = undo.zobristHash;
+        superkoHistory_.undoInsert(undo.superkoRecord);
+        lastMovePoint = undo.lastMovePoint;
+        koPoint = undo.koPoint;
+        koPlayer = undo.koPlayer;
+        legal_ = undo.legal;
+        lastChanged_ = undo.lastChanged;
+        lastChangedValid_ = undo.lastChangedValid;
+        std::for_each(undo.patternChanges.rbegin(), undo.patternChanges.rend(),
+                      [&](const std::pair<std::size_t, std::uint32_t> &item) {
+                          patterns_[item.first] = item.second;
+                      });
+
+        std::for_each(undo.gridChanges.rbegin(), undo.gridChanges.rend(),
+                      [&](const std::pair<PointType, PointState> &item) {
+                          setCell(item.first, item.second);
+                      });
+        std::for_each(undo.stoneLinkChanges.rbegin(), undo.stoneLinkChanges.rend(),
+                      [&](const std::pair<PointType, PointType> &item) {
+                          nextStone_[pointToIndex(item.first)] = item.second;
+                      });
+        posGroup_.revert(undo.posGroupChanges);
+
+        // Revert operations on groups_ in reverse order: frees after newGroup is allocated, the allocation,
+        // then frees of captured groups. So the free list ends up exactly as before.
+        for (std::size_t i = undo.freedGroups.size(); i > undo.freedBeforeNew; --i)
+            groups_.revertFree(undo.freedGroups[i - 1]);
+        groups_.revertAlloc(undo.newGroup);
+        for (std::size_t i = undo.freedBeforeNew; i > 0; --i)
+            groups_.revertFree(undo.freedGroups[i - 1]);
+        std::for_each(undo.groupChanges.rbegin(), undo.groupChanges.rend(),
+                      [&](const std::pair<GroupId, GroupNodeType> &item) {
+                          groups_[item.first] = item.second;
+                      });
+        // Every group the move changed is in groupChanges, but for the new one
+        for (const std::pair<GroupId, GroupNodeType> &item: undo.groupChanges)
+            refreshLowLiberty(item.first);
+        refreshLowLiberty(undo.newGroup);
+
+        --journal.size_;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W,H>::placeImpl(PointType p, Player player, UndoEntry *undo)
+    {
+        // Checked once, as this is called for every move
+        spdlog::logger *log = logger();
+        const bool trace = log->should_log(spdlog::level::trace);
+        if (trace)
+            log->trace("Place at {}, {}: {}", (int)p.x, (int)p.y, (int) player);
         if (getPointState(p) != PointState::NA)
             throw std::runtime_error("Try to place on an non-empty point");
 
-        boardGrid_.set(p, getPointStateFromPlayer(player));
+        setGrid(p, getPointStateFromPlayer(player), undo);
 
         Player opponent = getOpponentPlayer(player);
-
-        // --- Decrease liberty of adjacent groups
-        std::vector<GroupIterator> adjGroups = getAdjacentGroups(p);
-        std::for_each(adjGroups.begin(), adjGroups.end(), [&](GroupIterator group) {
-            logger->trace("Adjacent groups's liberty: {}", group->getLiberty());
-        });
+        TouchedSet touched;
+        PointType oldKoPoint = koPoint;
 
         std::size_t removed_stones = 0;
         PointType last_removed_point {-1, -1};
-        // Update liberty and remove opponent's dead groups (liberty of our group may change)
-        p.for_each_adjacent([&](PointType adjP) {
-            GroupIterator group = getPointGroup_(adjP);
-            if (group != groupEnd())
+        // --- Decrease liberty of adjacent groups, and remove opponent's dead groups (liberty of our group may change)
+        // A group next to p through several stones loses p once
+        std::array<GroupId, 4> filled;
+        std::size_t filledCnt = 0;
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState == PointState::B || adjState == PointState::W)
             {
-                group->setLiberty(p, false);
-                if (group->getPlayer() == opponent && group->getLiberty() == 0)
+                GroupId group = getPointGroup_(adjP);
+                if (std::find(filled.begin(), filled.begin() + filledCnt, group) != filled.begin() + filledCnt)
+                    return;
+                filled[filledCnt++] = group;
+                if (trace)
+                    log->trace("Adjacent groups's liberty: {}", groups_[group].getLiberty());
+                // It may have gained liberties already, by capture of a group adjacent to p as well
+                std::size_t oldLiberty = touched.addGroup(group, groups_[group].getLiberty());
+                if (groups_[group].getPlayer() == player)
+                    touched.mergedLiberties[touched.mergedCnt++] = oldLiberty;
+                removeGroupLiberty(group, undo);
+                if (groups_[group].getPlayer() == opponent && groups_[group].getLiberty() == 0)
                 {
-                    removed_stones += group->getStoneCnt();
-                    logger->trace("Removing group with liberty {}", group->getLiberty());
+                    removed_stones += groups_[group].getStoneCnt();
+                    if (trace)
+                        log->trace("Removing group with liberty {}", groups_[group].getLiberty());
                     last_removed_point = adjP;
-                    removeGroupFromPos(adjP);
+                    removeGroup(group, undo, touched);
                 }
             }
         });
 
         // --- Add this group
-        logger->trace("Adding this group");
-
-        GroupNodeType gn(player, 1);
-        p.for_each_adjacent([&](PointType adjP) {
-            logger->trace("Adjacent point {},{} is empty, setting liberty", (int)adjP.x, (int)adjP.y);
-            if (getPointState(adjP) == PointState::NA)
-                gn.setLiberty(adjP, true);
-            logger->trace("Current liberty: {}", gn.getLiberty());
+        if (trace)
+            log->trace("Adding this group");
+
+        std::size_t liberty = 0;
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState == PointState::NA)
+            {
+                if (trace)
+                    log->trace("Adjacent point {},{} is empty, counting liberty", (int)adjP.x, (int)adjP.y);
+                ++liberty;
+            }
         });
-        auto thisGroup = groupNodeList_.insert(groupNodeList_.cbegin(), gn);
-        posGroup_.set(p, thisGroup);
-        logger->trace("After set: {}", *this);
+        GroupNodeType gn(player, 1, liberty);
+        gn.setHead(p);
+        GroupId thisGroup = groups_.alloc(gn);
+        if (undo)
+        {
+            undo->newGroup = thisGroup;
+            undo->freedBeforeNew = undo->freedGroups.size();
+        }
+        posGroup_.set(p, thisGroup, undo ? &undo->posGroupChanges : nullptr);
+        setNextStone(p, p, undo);
+        if (trace)
+            log->trace("After set: {}", *this);
 
         // --- Merge our group
-        logger->trace("Merging group");
-        p.for_each_adjacent([&](PointType adjP) {
-            GroupIterator adjPointGroup = getPointGroup_(adjP);
-            if (adjPointGroup != groupNodeList_.end() &&
-                    adjPointGroup->getPlayer() == player &&
-                    adjPointGroup != thisGroup)
+        if (trace)
+            log->trace("Merging group");
+        PointState ourState = getPointStateFromPlayer(player);
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState == ourState && getPointGroup_(adjP) != thisGroup)
             {
-                logger->trace("Merging group with liberty {}", adjPointGroup->getLiberty());
-                mergeGroupAt(p, adjP);
+                if (trace)
+                    log->trace("Merging group with liberty {}", groups_[getPointGroup_(adjP)].getLiberty());
+                mergeGroupAt(p, adjP, undo);
             }
         });
 
-        if (thisGroup->getStoneCnt() == 1 && thisGroup->getLiberty() == 1 && removed_stones == 1)
+        if (groups_[thisGroup].getStoneCnt() == 1 && groups_[thisGroup].getLiberty() == 1 && removed_stones == 1)
         {
             koPoint = last_removed_point;
             koPlayer = opponent;
@@ -404,31 +1163,186 @@ namespace board
             koPoint = PointType(-1, -1);
 
         // --- remove our dead groups
-        if (thisGroup->getLiberty() == 0) {
-            removeGroup(thisGroup);
-            logger->trace("Removing self...");
-        }
-        p.for_each_adjacent([&](PointType p) {
-            GroupIterator adjPointGroup = getPointGroup_(p);
-            if (adjPointGroup != groupNodeList_.end() && adjPointGroup->getLiberty() == 0) {
-                logger->trace("Removing group at ({}, {})", (int)p.x, (int) p.y);
-            }
-        });
-        logger->trace("After move:{}", *this);
-        std::hash<Board> h;
-        std::size_t hash_v = h(*this);
-        logger->trace("last 2 hash: {}, last 1 hash: {}, cur Hash: {}", lastStateHash_, curStateHash_, hash_v);
+        touched.newGroup = thisGroup;
+        if (groups_[thisGroup].getLiberty() == 0) {
+            removeGroup(thisGroup, undo, touched);
+            if (trace)
+                log->trace("Removing self...");
+        }
+        updateLegal(p, touched, oldKoPoint);
+        updatePatterns(p, touched, undo);
+        for (std::size_t i = 0; i < touched.groupCnt; ++i)
+            refreshLowLiberty(touched.groups[i]);
+        refreshLowLiberty(touched.newGroup);
+        if (trackChanges_)
+            markChanged(p, touched, oldKoPoint);
+        lastChangedValid_ = trackChanges_;
+        if (trace)
+            log->trace("After move:{}", *this);
+        std::size_t hash_v = static_cast<std::size_t>(zobristHash_);
+        if (trace)
+            log->trace("last 2 hash: {}, last 1 hash: {}, cur Hash: {}", lastStateHash_, curStateHash_, hash_v);
         lastStateHash_ = curStateHash_;
         curStateHash_ = hash_v;
+        if (superko_)
+        {
+            typename SuperkoHistoryType::InsertRecord record = superkoHistory_.insert(zobristHash_);
+            if (undo)
+                undo->superkoRecord = record;
+        }
         lastMovePoint = p;
         ++step_;
-        if (placeHistory_.size() >= MAX_HISTORY_LENGTH)
-            placeHistory_.pop();
-        placeHistory_.push(p);
+        if (placeHistorySize_ >= MAX_HISTORY_LENGTH)
+        {
+            placeHistory_[placeHistoryBegin_] = p;
+            placeHistoryBegin_ = (placeHistoryBegin_ + 1) % MAX_HISTORY_LENGTH;
+        }
+        else
+            placeHistory_[(placeHistoryBegin_ + placeHistorySize_++) % MAX_HISTORY_LENGTH] = p;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::refreshLegal(PointType p)
+    {
+        // Same as getRulePosStatus(p, player) == OK for both players, looking at the neighbours once
+        std::size_t v = LayoutType::vertex(p);
+        std::array<bool, 2> ok = {false, false};
+        if (cells_[v] == PointState::NA)
+        {
+            bool hasFree = false;
+            for (std::size_t i = 0; i < 4; ++i)
+                hasFree = hasFree || cells_[v + LayoutType::ADJ[i]] == PointState::NA;
+            if (hasFree)
+                ok = {true, true};
+            else
+                forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+                    if (adjState != PointState::B && adjState != PointState::W)
+                        return;
+                    const GroupNodeType &group = groups_[getPointGroup_(adjP)];
+                    Player owner = group.getPlayer();
+                    // Joining a group with another liberty, or capturing a group in atari
+                    if (group.getLiberty() > 1)
+                        ok[static_cast<std::size_t>(owner)] = true;
+                    else
+                        ok[static_cast<std::size_t>(getOpponentPlayer(owner))] = true;
+                });
+            if (p == koPoint)
+                ok[static_cast<std::size_t>(koPlayer)] = false;
+        }
+        legal_[static_cast<std::size_t>(Player::W)].set(p, ok[static_cast<std::size_t>(Player::W)]);
+        legal_[static_cast<std::size_t>(Player::B)].set(p, ok[static_cast<std::size_t>(Player::B)]);
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::resetLegal()
+    {
+        legal_[0].clear();
+        legal_[1].clear();
+        PointType::for_all([&](PointType p) {
+            refreshLegal(p);
+        });
+    }
+
+    // Legality of an empty point depends only on its neighbours, the ko point and whether adjacent groups are
+    // in atari. A point whose neighbour is filled or emptied is itself filled, emptied or next to p.
+    // Other points only need checking around groups which went into or out of atari.
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::updateLegal(PointType p, const TouchedSet &touched, PointType oldKoPoint)
+    {
+        auto refreshLiberties = [&](GroupId group) {
+            forEachStone_(group, [&](PointType stone) {
+                forEachAdjacent_(stone, [&](PointType adjP, PointState adjState) {
+                    if (adjState == PointState::NA)
+                        refreshLegal(adjP);
+                });
+            });
+        };
+        refreshLegal(p);
+        for (std::size_t i = 0; i < touched.pointCnt; ++i)
+            refreshLegal(touched.points[i]);
+        for (std::size_t i = 0; i < touched.groupCnt; ++i)
+        {
+            GroupId group = touched.groups[i];
+            // Skip merged or captured groups, and the group of p whose id may be that of a captured one
+            if (group == touched.newGroup || groups_[group].getStoneCnt() == 0)
+                continue;
+            if ((touched.oldLiberties[i] == 1) != groups_[group].isInAtari())
+                refreshLiberties(group);
+        }
+        if (groups_[touched.newGroup].getStoneCnt() != 0)
+        {
+            // Liberties of the new group were those of p or of the merged groups
+            bool inAtari = groups_[touched.newGroup].isInAtari();
+            bool changed = false;
+            for (std::size_t i = 0; i < touched.mergedCnt; ++i)
+                changed = changed || (touched.mergedLiberties[i] == 1) != inAtari;
+            if (changed)
+                refreshLiberties(touched.newGroup);
+            else
+                forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+                    if (adjState == PointState::NA)
+                        refreshLegal(adjP);
+                });
+        }
+        if (oldKoPoint != PointType(-1, -1))
+            refreshLegal(oldKoPoint);
+        if (koPoint != PointType(-1, -1))
+            refreshLegal(koPoint);
+    }
+
+    // Called before p is put into history, so that the history before and after this move is covered
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::markChanged(PointType p, const TouchedSet &touched, PointType oldKoPoint)
+    {
+        // Eye shape of a point depends on its 8 neighbours
+        const std::array<PointSetType, W * H> &neighbourhoods = getNeighbourhoods();
+        lastChanged_ = neighbourhoods[pointToIndex(p)];
+        for (std::size_t i = 0; i < touched.pointCnt; ++i)
+            lastChanged_ |= neighbourhoods[pointToIndex(touched.points[i])];
+        // Features of a stone see the liberty of its group only up to 4, and its size only in atari
+        auto libertyClass = [](std::size_t liberty) {
+            return std::min<std::size_t>(liberty, 4);
+        };
+        auto markStones = [&](GroupId group) {
+            forEachStone_(group, [&](PointType stone) {
+                lastChanged_.set(stone, true);
+            });
+        };
+        for (std::size_t i = 0; i < touched.groupCnt; ++i)
+        {
+            GroupId group = touched.groups[i];
+            if (group != touched.newGroup && groups_[group].getStoneCnt() != 0 &&
+                    libertyClass(touched.oldLiberties[i]) != libertyClass(groups_[group].getLiberty()))
+                markStones(group);
+        }
+        const GroupNodeType &newGroup = groups_[touched.newGroup];
+        if (newGroup.getStoneCnt() != 0)
+        {
+            bool changed = newGroup.isInAtari();
+            for (std::size_t i = 0; i < touched.mergedCnt; ++i)
+                changed = changed || libertyClass(touched.mergedLiberties[i]) != libertyClass(newGroup.getLiberty());
+            if (changed)
+                markStones(touched.newGroup);
+        }
+        for (std::size_t i = 0; i < placeHistorySize_; ++i)
+            lastChanged_.set(placeHistory_[(placeHistoryBegin_ + i) % MAX_HISTORY_LENGTH], true);
+        if (oldKoPoint != PointType(-1, -1))
+            lastChanged_.set(oldKoPoint, true);
+        if (koPoint != PointType(-1, -1))
+            lastChanged_.set(koPoint, true);
     }
 
     template<std::size_t W, std::size_t H>
     auto Board<W,H>::getPosStatus(PointType p, Player player) const -> typename Board::PositionStatus
+    {
+        PositionStatus status = getRulePosStatus(p, player);
+        if (status == PositionStatus::OK && superko_ && isSuperko(p, player))
+            return PositionStatus::SUPERKO;
+        return status;
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W,H>::getRulePosStatus(PointType p, Player player) const -> typename Board::PositionStatus
     {
         if (getPointState(p) != PointState::NA)
             return PositionStatus::NOTEMPTY;
@@ -438,16 +1352,16 @@ namespace board
 
         int our_group_liberty_greater_than_1 = 0, oppo_group_liberty_1 = 0;
         bool has_free = false;
-        p.for_each_adjacent([&](PointType adjP) {
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
             if (!has_free) {
-                auto group = getPointGroup_(adjP);
-                if (group != groupEnd()) {
-                    if (group->getPlayer() == player && group->getLiberty() > 1)
+                if (adjState == PointState::B || adjState == PointState::W) {
+                    GroupId group = getPointGroup_(adjP);
+                    if (groups_[group].getPlayer() == player && groups_[group].getLiberty() > 1)
                         ++our_group_liberty_greater_than_1;
-                    if (group->getPlayer() != player && group->getLiberty() == 1)
+                    if (groups_[group].getPlayer() != player && groups_[group].getLiberty() == 1)
                         ++oppo_group_liberty_1;
                 }
-                else
+                else if (adjState == PointState::NA)
                 {
                     has_free = true;
                 }
@@ -459,13 +1373,38 @@ namespace board
         return PositionStatus::OK;
     };
 
+    template<std::size_t W, std::size_t H>
+    bool Board<W, H>::isSuperko(PointType p, Player player) const
+    {
+        if (!superko_)
+            return false;
+        std::uint64_t hash = zobristHash_ ^ ZobristType::stoneKey(p, getPointStateFromPlayer(player));
+
+        // Take away stones of opponent's groups which lose their last liberty
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(player));
+        GroupConstIterator captured[4];
+        std::size_t captured_cnt = 0;
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState != oppoState)
+                return;
+            GroupConstIterator group = getPointGroup(adjP);
+            if (group->getLiberty() != 1 || std::find(captured, captured + captured_cnt, group) != captured + captured_cnt)
+                return;
+            captured[captured_cnt++] = group;
+            forEachStone(group, [&](PointType stone) {
+                hash ^= ZobristType::stoneKey(stone, oppoState);
+            });
+        });
+        return superkoHistory_.contains(hash);
+    }
+
     template<std::size_t W, std::size_t H>
     auto Board<W, H>::getPosStatusAndPlace(PointType p, Player player) -> typename Board::PositionStatus
     {
         if (getPointState(p) != PointState::NA)
             return Board::PositionStatus::NOTEMPTY;
         Board &testBoard = *this;
-        logger->trace("After copy: {}", testBoard);
+        logger()->trace("After copy: {}", testBoard);
 
         std::size_t last2hash = testBoard.lastStateHash_;
         testBoard.place(p, player);
@@ -478,14 +1417,40 @@ namespace board
         return Board::PositionStatus::OK;
     }
 
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::getAtariLiberty(GroupConstIterator group) const -> PointType
+    {
+        if (group == groupEnd() || !group->isInAtari())
+            return PointType(-1, -1);
+        return lowLiberties_[group.id()].liberties[0];
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::getCaptureSet(PointType p, Player player) const -> BitboardType
+    {
+        BitboardType captured, point;
+        point.set(p);
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(player));
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState != oppoState || captured.test(adjP))
+                return;
+            BitboardType group = getGroupStones(adjP);
+            if (((group.neighbours() & getPlane(PointState::NA)) - point).any())
+                return;
+            captured |= group;
+        });
+        return captured;
+    }
+
     template<std::size_t W, std::size_t H>
     bool Board<W, H>::isEye(PointType p, Player player) const
     {
         if (getPointState(p) != PointState::NA)
             return false;
         bool isEye = true;
-        p.for_each_adjacent([&](PointType adjP){
-            if (getPointState(adjP) != getPointStateFromPlayer(player))
+        PointState ourState = getPointStateFromPlayer(player);
+        forEachAdjacent_(p, [&](PointType, PointState adjState) {
+            if (adjState != ourState && adjState != LayoutType::BORDER)
                 isEye = false;
         });
         return isEye;
@@ -497,8 +1462,9 @@ namespace board
         if (!isEye(p, player))
             return false;
         std::size_t oppo_cnt = 0, empty_cnt = 0, all_cnt = 0;
-        p.for_each_diag([&](PointType adjP) {
-            PointState ps = getPointState(adjP);
+        forEachDiag_(p, [&](PointType adjP, PointState ps) {
+            if (ps == LayoutType::BORDER)
+                return;
             ++all_cnt;
             if (ps == PointState::NA) {
                 if (!isEye(adjP, player))
@@ -515,11 +1481,10 @@ namespace board
     bool Board<W, H>::isFakeEye(PointType p, Player player) const
     {
         std::size_t oppo_cnt = 0, all_cnt = 0;
-        p.for_each_diag([&](PointType adjP) {
-            ++all_cnt;
-            PointState ps = getPointState(adjP);
-            if (ps != PointState::NA && ps != getPointStateFromPlayer(player))
-                ++oppo_cnt;
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(player));
+        forEachDiag_(p, [&](PointType, PointState ps) {
+            all_cnt += ps != LayoutType::BORDER;
+            oppo_cnt += ps == oppoState;
         });
         return (all_cnt < 4 && oppo_cnt >= 1) ||
                 (all_cnt == 4 && oppo_cnt >=2);
@@ -537,79 +1502,54 @@ namespace board
         if (getPointState(p) != PointState::NA)
             return false;
 
+        PointState ourState = getPointStateFromPlayer(player);
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(player));
         int liberty = 4;
-
-        if (p.x == 0 || p.x == H - 1)
-            --liberty;
-        if (p.y == 0 || p.y == W - 1)
-            --liberty;
-
-        std::vector<GroupConstIterator> groupList;
-        groupList.reserve(4);
-
+        // Group of each neighbour in the order of LayoutType::ADJ, NO_GROUP if it holds no stone
+        std::array<GroupId, 4> adjGroups;
+        std::size_t i = 0;
         bool captureOpponent = false;
 
-        p.for_each_adjacent([&](PointType adjP) {
-            GroupConstIterator adjGroup = getPointGroup(adjP);
-            if (getPointState(adjP) == getPointStateFromPlayer(getOpponentPlayer(player)))
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            adjGroups[i] = NO_GROUP;
+            if (adjState == LayoutType::BORDER)
+                --liberty;
+            else if (adjState == oppoState)
             {
-                if (adjGroup->getLiberty() <= 1)
+                adjGroups[i] = getPointGroup_(adjP);
+                if (groups_[adjGroups[i]].getLiberty() <= 1)
                     captureOpponent = true;
                 --liberty;
             }
-            else if (getPointState(adjP) == getPointStateFromPlayer(player))
-                groupList.push_back(adjGroup);
+            else if (adjState == ourState)
+            {
+                adjGroups[i] = getPointGroup_(adjP);
+                std::size_t duplicated = std::count(adjGroups.begin(), adjGroups.begin() + i, adjGroups[i]);
+                if (duplicated)
+                    liberty -= 2 * static_cast<int>(duplicated);
+                else
+                    liberty += static_cast<int>(groups_[adjGroups[i]].getLiberty()) - 2;
+            }
+            ++i;
         });
 
         if (captureOpponent)
             return false;
 
-        for (typename std::vector<GroupConstIterator>::iterator iter = groupList.begin(); iter != groupList.end(); ++iter)
+        // An empty diagonal point between two different opponent groups. DIAG[i] lies between ADJ[i < 2 ? 0 : 2]
+        // (left or right) and ADJ[i % 2 ? 3 : 1] (down or up)
+        std::size_t v = LayoutType::vertex(p);
+        for (i = 0; i < 4; ++i)
         {
-            bool duplicated = false;
-            for (typename std::vector<GroupConstIterator>::iterator iter2 = groupList.begin(); iter2 != iter; ++iter2)
-                if (*iter == *iter2)
-                {
-                    liberty -= 2;
-                    duplicated = true;
-                }
-
-            if (!duplicated)
-                liberty += (*iter)->getLiberty() - 2;
-        }
-
-        if ((!p.is_left() && !p.is_top()) &&
-                (getPointState(p.left_up_point()) == PointState::NA) &&
-                (getPointState(p.left_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointState(p.up_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointGroup(p.left_point()) != getPointGroup(p.up_point())))
-            --liberty;
-
-        if ((!p.is_left() && !p.is_bottom()) &&
-                (getPointState(p.left_down_point()) == PointState::NA) &&
-                (getPointState(p.left_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointState(p.down_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointGroup(p.left_point()) != getPointGroup(p.down_point())))
-            --liberty;
-
-        if ((!p.is_right() && !p.is_top()) &&
-                (getPointState(p.right_up_point()) == PointState::NA) &&
-                (getPointState(p.right_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointState(p.up_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointGroup(p.right_point()) != getPointGroup(p.up_point())))
-            --liberty;
-
-        if ((!p.is_right() && !p.is_bottom()) &&
-                (getPointState(p.right_down_point()) == PointState::NA) &&
-                (getPointState(p.right_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointState(p.down_point()) == getPointStateFromPlayer(getOpponentPlayer(player))) &&
-                (getPointGroup(p.right_point()) != getPointGroup(p.down_point())))
-            --liberty;
-
-        if (liberty >= 2)
-            return false;
+            std::size_t side = i < 2 ? 0 : 2, vertical = i % 2 ? 3 : 1;
+            if (cells_[v + LayoutType::DIAG[i]] == PointState::NA &&
+                    cells_[v + LayoutType::ADJ[side]] == oppoState &&
+                    cells_[v + LayoutType::ADJ[vertical]] == oppoState &&
+                    adjGroups[side] != adjGroups[vertical])
+                --liberty;
+        }
 
-        return true;
+        return liberty < 2;
     }
 
     template<std::size_t W, std::size_t H>
@@ -638,7 +1578,7 @@ namespace board
         {
             o << j + 1 << '\t';
             for (int i=0; i<W; ++i)
-                o << (int) b.boardGrid_.get(PT {(char)i, (char)j}) << ' ';
+                o << (int) b.getPointState(PT {(char)i, (char)j}) << ' ';
             o << std::endl;
         }
         o << "Group Liberties"<< std::endl;
@@ -648,7 +1588,7 @@ namespace board
             for (int i=0; i<W; ++i) {
                 PT p {(char)i, (char)j};
                 auto group = b.getPointGroup(p);
-                if (group == b.groupNodeList_.end())
+                if (group == b.groupEnd())
                     o << "O\t";
                 else
                     o << group->getLiberty() << "\t";
@@ -659,367 +1599,404 @@ namespace board
     }
 
     template<std::size_t W, std::size_t H>
-    auto Board<W, H>::generateRequestV1(Player player) -> gocnn::RequestV1
+    auto Board<W, H>::generateRequestV1(Player player) const -> gocnn::RequestV1
     {
         gocnn::RequestV1 reqv1;
+        generateRequestV1(player, reqv1);
+        return reqv1;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::generateRequestV1(Player player, gocnn::RequestV1 &reqv1) const
+    {
+        google::protobuf::RepeatedField<bool> *planes[FEATURE_V1_PLANES] = {
+                reqv1.mutable_our_group_lib1(), reqv1.mutable_our_group_lib2(), reqv1.mutable_our_group_lib3_plus(),
+                reqv1.mutable_oppo_group_lib1(), reqv1.mutable_oppo_group_lib2(), reqv1.mutable_oppo_group_lib3_plus(),
+                reqv1.mutable_is_simple_ko()
+        };
         reqv1.set_board_size(W * H);
-        reqv1.mutable_is_simple_ko()->Reserve(reqv1.board_size());
-        reqv1.mutable_our_group_lib1()->Reserve(reqv1.board_size());
-        reqv1.mutable_our_group_lib2()->Reserve(reqv1.board_size());
-        reqv1.mutable_our_group_lib3_plus()->Reserve(reqv1.board_size());
-        reqv1.mutable_oppo_group_lib1()->Reserve(reqv1.board_size());
-        reqv1.mutable_oppo_group_lib2()->Reserve(reqv1.board_size());
-        reqv1.mutable_oppo_group_lib3_plus()->Reserve(reqv1.board_size());
+        for (google::protobuf::RepeatedField<bool> *plane: planes)
+        {
+            plane->Clear();
+            plane->Resize(W * H, false);
+        }
         PointType::for_all([&](PointType p) {
-            auto group = getPointGroup(p);
-            if (koPlayer == player && koPoint == p)
-                reqv1.add_is_simple_ko(true);
-            else
-                reqv1.add_is_simple_ko(false);
-            bool is_empty = group == groupEnd();
-            if (is_empty)
-            {
-                reqv1.add_our_group_lib1(false);
-                reqv1.add_our_group_lib2(false);
-                reqv1.add_our_group_lib3_plus(false);
-                reqv1.add_oppo_group_lib1(false);
-                reqv1.add_oppo_group_lib2(false);
-                reqv1.add_oppo_group_lib3_plus(false);
-            } else
-            {
-                bool is_our = group->getPlayer() == player;
-                std::size_t lib = group->getLiberty();
-                if (is_our)
-                {
-                    reqv1.add_our_group_lib1(lib == 1);
-                    reqv1.add_our_group_lib2(lib == 2);
-                    reqv1.add_our_group_lib3_plus(lib >= 3);
-                    reqv1.add_oppo_group_lib1(false);
-                    reqv1.add_oppo_group_lib2(false);
-                    reqv1.add_oppo_group_lib3_plus(false);
-                } else
-                {
-                    reqv1.add_oppo_group_lib1(lib == 1);
-                    reqv1.add_oppo_group_lib2(lib == 2);
-                    reqv1.add_oppo_group_lib3_plus(lib >= 3);
-                    reqv1.add_our_group_lib1(false);
-                    reqv1.add_our_group_lib2(false);
-                    reqv1.add_our_group_lib3_plus(false);
-                }
-            }
+            std::size_t idx = pointToIndex(p);
+            forEachPointFeatureV1(player, p, [&](std::size_t plane, float) {
+                planes[plane]->Set(idx, true);
+            });
         });
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestV1(Player player, google::protobuf::Arena *arena) const -> gocnn::RequestV1 *
+    {
+        gocnn::RequestV1 *reqv1 = google::protobuf::Arena::CreateMessage<gocnn::RequestV1>(arena);
+        generateRequestV1(player, *reqv1);
         return reqv1;
     }
 
     template<std::size_t W, std::size_t H>
-    auto Board<W, H>::generateRequestV2(Player player) -> gocnn::RequestV2
+    auto Board<W, H>::generateRequestV2(Player player) const -> gocnn::RequestV2
+    {
+        gocnn::RequestV2 reqv2;
+        generateRequestV2(player, reqv2);
+        return reqv2;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::generateRequestV2(Player player, gocnn::RequestV2 &reqv2) const
+    {
+        fillRequestV2(player, FeatureSet::V2, reqv2);
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestV2(Player player, google::protobuf::Arena *arena) const -> gocnn::RequestV2 *
+    {
+        gocnn::RequestV2 *reqv2 = google::protobuf::Arena::CreateMessage<gocnn::RequestV2>(arena);
+        fillRequestV2(player, FeatureSet::V2, *reqv2);
+        return reqv2;
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestV2Bug(Player player) const -> gocnn::RequestV2
     {
         gocnn::RequestV2 reqv2;
+        generateRequestV2Bug(player, reqv2);
+        return reqv2;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::generateRequestV2Bug(Player player, gocnn::RequestV2 &reqv2) const
+    {
+        fillRequestV2(player, FeatureSet::V2Bug, reqv2);
+    }
+
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestV2Bug(Player player, google::protobuf::Arena *arena) const -> gocnn::RequestV2 *
+    {
+        gocnn::RequestV2 *reqv2 = google::protobuf::Arena::CreateMessage<gocnn::RequestV2>(arena);
+        fillRequestV2(player, FeatureSet::V2Bug, *reqv2);
+        return reqv2;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::fillRequestV2(Player player, FeatureSet set, gocnn::RequestV2 &reqv2) const
+    {
+        // All but position, in order of field number
+        google::protobuf::RepeatedField<bool> *planes[FEATURE_V2_PLANES - 1] = {
+                reqv2.mutable_stone_color_our(), reqv2.mutable_stone_color_oppo(), reqv2.mutable_stone_color_empty(),
+                reqv2.mutable_turns_since_one(), reqv2.mutable_turns_since_two(), reqv2.mutable_turns_since_three(),
+                reqv2.mutable_turns_since_four(), reqv2.mutable_turns_since_five(), reqv2.mutable_turns_since_six(),
+                reqv2.mutable_turns_since_seven(), reqv2.mutable_turns_since_more(),
+                reqv2.mutable_liberties_our_one(), reqv2.mutable_liberties_our_two(),
+                reqv2.mutable_liberties_our_three(), reqv2.mutable_liberties_our_more(),
+                reqv2.mutable_liberties_oppo_one(), reqv2.mutable_liberties_oppo_two(),
+                reqv2.mutable_liberties_oppo_three(), reqv2.mutable_liberties_oppo_more(),
+                reqv2.mutable_capture_size_one(), reqv2.mutable_capture_size_two(),
+                reqv2.mutable_capture_size_three(), reqv2.mutable_capture_size_four(),
+                reqv2.mutable_capture_size_five(), reqv2.mutable_capture_size_six(),
+                reqv2.mutable_capture_size_seven(), reqv2.mutable_capture_size_more(),
+                reqv2.mutable_self_atari_one(), reqv2.mutable_self_atari_two(),
+                reqv2.mutable_self_atari_three(), reqv2.mutable_self_atari_four(),
+                reqv2.mutable_self_atari_five(), reqv2.mutable_self_atari_six(),
+                reqv2.mutable_self_atari_seven(), reqv2.mutable_self_atari_more(),
+                reqv2.mutable_sensibleness(), reqv2.mutable_ko(), reqv2.mutable_border()
+        };
+        google::protobuf::RepeatedField<float> *position = reqv2.mutable_position();
         reqv2.set_board_size(W * H);
-        reqv2.mutable_stone_color_our()->Reserve(reqv2.board_size());
-        reqv2.mutable_stone_color_oppo()->Reserve(reqv2.board_size());
-        reqv2.mutable_stone_color_empty()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_one()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_two()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_three()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_four()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_five()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_six()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_seven()->Reserve(reqv2.board_size());
-        reqv2.mutable_turns_since_more()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_our_one()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_our_two()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_our_three()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_our_more()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_oppo_one()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_oppo_two()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_oppo_three()->Reserve(reqv2.board_size());
-        reqv2.mutable_liberties_oppo_more()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_one()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_two()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_three()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_four()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_five()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_six()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_seven()->Reserve(reqv2.board_size());
-        reqv2.mutable_capture_size_more()->Reserve(reqv2.board_size());
-        reqv2.mutable_sensibleness()->Reserve(reqv2.board_size());
-        reqv2.mutable_ko()->Reserve(reqv2.board_size());
-        reqv2.mutable_border()->Reserve(reqv2.board_size());
-        reqv2.mutable_position()->Reserve(reqv2.board_size());
-
-        std::queue<PointType> placeHistory = getHistoryCopy();
-        PointType lastOnePlace(-1, -1);
-        PointType lastTwoPlace(-1, -1);
-        PointType lastThreePlace(-1, -1);
-        PointType lastFourPlace(-1, -1);
-        PointType lastFivePlace(-1, -1);
-        PointType lastSixPlace(-1, -1);
-        PointType lastSevenPlace(-1, -1);
-        switch (placeHistory.size())
-        {
-            case 0:
-                break;
-            case 1:
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 2:
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 3:
-                lastThreePlace = placeHistory.front();
-                placeHistory.pop();
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 4:
-                lastFourPlace = placeHistory.front();
-                placeHistory.pop();
-                lastThreePlace = placeHistory.front();
-                placeHistory.pop();
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 5:
-                lastFivePlace = placeHistory.front();
-                placeHistory.pop();
-                lastFourPlace = placeHistory.front();
-                placeHistory.pop();
-                lastThreePlace = placeHistory.front();
-                placeHistory.pop();
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 6:
-                lastSixPlace = placeHistory.front();
-                placeHistory.pop();
-                lastFivePlace = placeHistory.front();
-                placeHistory.pop();
-                lastFourPlace = placeHistory.front();
-                placeHistory.pop();
-                lastThreePlace = placeHistory.front();
-                placeHistory.pop();
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            case 7:
-                lastSevenPlace = placeHistory.front();
-                placeHistory.pop();
-                lastSixPlace = placeHistory.front();
-                placeHistory.pop();
-                lastFivePlace = placeHistory.front();
-                placeHistory.pop();
-                lastFourPlace = placeHistory.front();
-                placeHistory.pop();
-                lastThreePlace = placeHistory.front();
-                placeHistory.pop();
-                lastTwoPlace = placeHistory.front();
-                placeHistory.pop();
-                lastOnePlace = placeHistory.front();
-                placeHistory.pop();
-                break;
-            default:
-                break;
+        // Clear() keeps the capacity, so a reused message is filled without allocation
+        for (google::protobuf::RepeatedField<bool> *plane: planes)
+        {
+            plane->Clear();
+            plane->Resize(W * H, false);
         }
-        PointType::for_all([&](PointType p) {
-            bool isEmpty = (getPointState(p) == PointState::NA);
-            bool isOurs = (getPointState(p) == getPointStateFromPlayer(player));
-            auto group = *getPointGroup(p);
-            std::size_t liberty = 0;
-            std::size_t stoneCount = 0;
-            if (!isEmpty)
+        position->Clear();
+        position->Add(pointTables().position.begin(), pointTables().position.end());
+        forEachFeature(player, set, [&](std::size_t plane, std::size_t idx, float) {
+            if (plane != FEATURE_V2_POSITION_PLANE)
+                planes[plane]->Set(idx, true);
+        });
+    }
+
+    template<std::size_t W, std::size_t H>
+    std::size_t Board<W, H>::getFeatureHistory(FeatureSet set, HistoryArray &history) const
+    {
+        std::size_t historySize = set == FeatureSet::V2 ? placeHistorySize_ : 0;
+        for (std::size_t i = 0; i < historySize; ++i)
+            history[i] = placeHistory_[(placeHistoryBegin_ + placeHistorySize_ - 1 - i) % MAX_HISTORY_LENGTH];
+        return historySize;
+    }
+
+    template<std::size_t W, std::size_t H>
+    template<typename FT>
+    void Board<W, H>::forEachPointFeature(Player player, FeatureSet set, PointType p,
+                                          const HistoryArray &history, std::size_t historySize, FT f) const
+    {
+        // Planes of RequestV2, numbered by field number - 2
+        enum: std::size_t
+        {
+            STONE_OUR = 0, STONE_OPPO = 1, STONE_EMPTY = 2, TURNS_SINCE = 3, TURNS_SINCE_MORE = 10,
+            LIBERTIES_OUR = 11, LIBERTIES_OPPO = 15, CAPTURE_SIZE = 19, SELF_ATARI = 27,
+            SENSIBLENESS = 35, KO = 36, BORDER = 37, POSITION = 38
+        };
+        if (set == FeatureSet::V1)
+        {
+            forEachPointFeatureV1(player, p, f);
+            return;
+        }
+        PointState state = getPointState(p);
+        bool isOurs = state == getPointStateFromPlayer(player);
+        bool isKo = koPlayer == player && koPoint == p;
+
+        bool inHistory = false;
+        for (std::size_t i = 0; i < historySize; ++i)
+            if (history[i] == p)
             {
-                liberty = group.getLiberty();
-                stoneCount = group.getStoneCnt();
+                f(TURNS_SINCE + i, 1.0f);
+                inHistory = true;
             }
+        if (state == PointState::NA)
+            f(STONE_EMPTY, 1.0f);
+        else
+        {
+            const GroupNodeType &group = groups_[getPointGroup_(p)];
+            std::size_t liberty = group.getLiberty();
+            f(isOurs ? STONE_OUR : STONE_OPPO, 1.0f);
+            f((isOurs ? LIBERTIES_OUR : LIBERTIES_OPPO) + std::min<std::size_t>(liberty, 4) - 1, 1.0f);
+            if (liberty == 1)
+                f((isOurs ? SELF_ATARI : CAPTURE_SIZE) + std::min<std::size_t>(group.getStoneCnt(), 8) - 1, 1.0f);
+            if (set == FeatureSet::V2 && !inHistory)
+                f(TURNS_SINCE_MORE, 1.0f);
+        }
+        if (set == FeatureSet::V2Bug)
+            f(TURNS_SINCE_MORE, 1.0f);
+        if (isTrueEye(p, player))
+            f(SENSIBLENESS, 1.0f);
+        if (isKo)
+            f(KO, 1.0f);
+        const PointTables &tables = pointTables();
+        std::size_t idx = pointToIndex(p);
+        if (tables.border[idx])
+            f(BORDER, 1.0f);
+        f(POSITION, tables.position[idx]);
+    }
 
-            if (isEmpty)
-            {
-                reqv2.add_stone_color_our(false);
-                reqv2.add_stone_color_oppo(false);
-                reqv2.add_stone_color_empty(true);
-
-                reqv2.add_liberties_our_one(false);
-                reqv2.add_liberties_our_two(false);
-                reqv2.add_liberties_our_three(false);
-                reqv2.add_liberties_our_more(false);
-
-                reqv2.add_liberties_oppo_one(false);
-                reqv2.add_liberties_oppo_two(false);
-                reqv2.add_liberties_oppo_three(false);
-                reqv2.add_liberties_oppo_more(false);
-
-                reqv2.add_self_atari_one(false);
-                reqv2.add_self_atari_two(false);
-                reqv2.add_self_atari_three(false);
-                reqv2.add_self_atari_four(false);
-                reqv2.add_self_atari_five(false);
-                reqv2.add_self_atari_six(false);
-                reqv2.add_self_atari_seven(false);
-                reqv2.add_self_atari_more(false);
-
-                reqv2.add_capture_size_one(false);
-                reqv2.add_capture_size_two(false);
-                reqv2.add_capture_size_three(false);
-                reqv2.add_capture_size_four(false);
-                reqv2.add_capture_size_five(false);
-                reqv2.add_capture_size_six(false);
-                reqv2.add_capture_size_seven(false);
-                reqv2.add_capture_size_more(false);
-            } else if (isOurs)
-            {
-                reqv2.add_stone_color_our(true);
-                reqv2.add_stone_color_oppo(false);
-                reqv2.add_stone_color_empty(false);
+    template<std::size_t W, std::size_t H>
+    template<typename FT>
+    void Board<W, H>::forEachPointFeatureV1(Player player, PointType p, FT f) const
+    {
+        PointState state = getPointState(p);
+        if (state != PointState::NA)
+            f((state == getPointStateFromPlayer(player) ? 0 : 3) +
+              std::min<std::size_t>(groups_[getPointGroup_(p)].getLiberty(), 3) - 1, 1.0f);
+        if (koPlayer == player && koPoint == p)
+            f(6, 1.0f);
+    }
 
-                reqv2.add_liberties_our_one(liberty == 1);
-                reqv2.add_liberties_our_two(liberty == 2);
-                reqv2.add_liberties_our_three(liberty == 3);
-                reqv2.add_liberties_our_more(liberty >= 4);
+    template<std::size_t W, std::size_t H>
+    template<typename FT>
+    void Board<W, H>::forEachFeature(Player player, FeatureSet set, FT f) const
+    {
+        HistoryArray history {};
+        std::size_t historySize = getFeatureHistory(set, history);
+        PointType::for_all([&](PointType p) {
+            std::size_t idx = pointToIndex(p);
+            forEachPointFeature(player, set, p, history, historySize, [&](std::size_t plane, float value) {
+                f(plane, idx, value);
+            });
+        });
+    }
 
-                reqv2.add_liberties_oppo_one(false);
-                reqv2.add_liberties_oppo_two(false);
-                reqv2.add_liberties_oppo_three(false);
-                reqv2.add_liberties_oppo_more(false);
+    template<std::size_t W, std::size_t H>
+    template<typename T>
+    void Board<W, H>::writeFeaturePlanesImpl(Player player, T *out, FeatureSet set, FeatureLayout layout) const
+    {
+        std::size_t planes = getFeaturePlaneCount(set);
+        std::fill(out, out + planes * W * H, T(0));
+        std::size_t scaledPlane = std::is_floating_point<T>::value || set == FeatureSet::V1 ?
+                                  planes : FEATURE_V2_POSITION_PLANE;
+        auto convert = [scaledPlane](std::size_t plane, float value) {
+            return plane == scaledPlane ? static_cast<T>(value * 255.0f + 0.5f) : static_cast<T>(value);
+        };
+        if (layout == FeatureLayout::NCHW)
+            forEachFeature(player, set, [&](std::size_t plane, std::size_t idx, float value) {
+                out[plane * W * H + idx] = convert(plane, value);
+            });
+        else
+            forEachFeature(player, set, [&](std::size_t plane, std::size_t idx, float value) {
+                out[idx * planes + plane] = convert(plane, value);
+            });
+    }
 
-                if (liberty == 1)
-                {
-                    reqv2.add_self_atari_one(stoneCount == 1);
-                    reqv2.add_self_atari_two(stoneCount == 2);
-                    reqv2.add_self_atari_three(stoneCount == 3);
-                    reqv2.add_self_atari_four(stoneCount == 4);
-                    reqv2.add_self_atari_five(stoneCount == 5);
-                    reqv2.add_self_atari_six(stoneCount == 6);
-                    reqv2.add_self_atari_seven(stoneCount == 7);
-                    reqv2.add_self_atari_more(stoneCount >= 8);
-                }
-                else
-                {
-                    reqv2.add_self_atari_one(false);
-                    reqv2.add_self_atari_two(false);
-                    reqv2.add_self_atari_three(false);
-                    reqv2.add_self_atari_four(false);
-                    reqv2.add_self_atari_five(false);
-                    reqv2.add_self_atari_six(false);
-                    reqv2.add_self_atari_seven(false);
-                    reqv2.add_self_atari_more(false);
-                }
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::writeFeaturePlanes(Player player, float *out, FeatureSet set, FeatureLayout layout) const
+    {
+        writeFeaturePlanesImpl(player, out, set, layout);
+    }
 
-                reqv2.add_capture_size_one(false);
-                reqv2.add_capture_size_two(false);
-                reqv2.add_capture_size_three(false);
-                reqv2.add_capture_size_four(false);
-                reqv2.add_capture_size_five(false);
-                reqv2.add_capture_size_six(false);
-                reqv2.add_capture_size_seven(false);
-                reqv2.add_capture_size_more(false);
-            }
-            else
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::writeFeaturePlanes(Player player, std::uint8_t *out, FeatureSet set, FeatureLayout layout) const
+    {
+        writeFeaturePlanesImpl(player, out, set, layout);
+    }
+
+    template<std::size_t W, std::size_t H>
+    gocnn::FeatureSet Board<W, H>::toMessageFeatureSet(FeatureSet set)
+    {
+        return set == FeatureSet::V1 ? gocnn::FEATURE_SET_V1 :
+               set == FeatureSet::V2 ? gocnn::FEATURE_SET_V2 : gocnn::FEATURE_SET_V2_BUG;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::packFeatures(Player player, FeatureSet set, char *out) const
+    {
+        std::size_t planeCnt = getPackedPlaneCount(set);
+        std::fill(out, out + planeCnt * PACKED_PLANE_BYTES, '\0');
+        forEachFeature(player, set, [&](std::size_t plane, std::size_t idx, float) {
+            if (plane < planeCnt)
+                out[plane * PACKED_PLANE_BYTES + idx / 8] |= static_cast<char>(1 << (idx % 8));
+        });
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::unpackFeatures(const char *packed, std::size_t planeCnt, bool withPosition, float *out)
+    {
+        for (std::size_t plane = 0; plane < planeCnt; ++plane)
+            for (std::size_t idx = 0; idx < W * H; ++idx)
+                out[plane * W * H + idx] = (packed[plane * PACKED_PLANE_BYTES + idx / 8] >> (idx % 8)) & 1;
+        if (withPosition)
+        {
+            const std::array<float, W * H> &position = pointTables().position;
+            std::copy(position.begin(), position.end(), out + FEATURE_V2_POSITION_PLANE * W * H);
+        }
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::packPossibility(const float *possibility, gocnn::ResponseV3::Encoding encoding, char *out)
+    {
+        if (encoding == gocnn::ResponseV3::UINT8)
+            for (std::size_t i = 0; i < W * H; ++i)
+                out[i] = static_cast<char>(static_cast<std::uint8_t>(
+                        std::min(std::max(possibility[i], 0.0f), 1.0f) * 255.0f + 0.5f));
+        else
+            for (std::size_t i = 0; i < W * H; ++i)
             {
-                reqv2.add_stone_color_our(false);
-                reqv2.add_stone_color_oppo(true);
-                reqv2.add_stone_color_empty(false);
-
-                reqv2.add_liberties_our_one(false);
-                reqv2.add_liberties_our_two(false);
-                reqv2.add_liberties_our_three(false);
-                reqv2.add_liberties_our_more(false);
-
-                reqv2.add_liberties_oppo_one(liberty == 1);
-                reqv2.add_liberties_oppo_two(liberty == 2);
-                reqv2.add_liberties_oppo_three(liberty == 3);
-                reqv2.add_liberties_oppo_more(liberty >= 4);
-
-                reqv2.add_self_atari_one(false);
-                reqv2.add_self_atari_two(false);
-                reqv2.add_self_atari_three(false);
-                reqv2.add_self_atari_four(false);
-                reqv2.add_self_atari_five(false);
-                reqv2.add_self_atari_six(false);
-                reqv2.add_self_atari_seven(false);
-                reqv2.add_self_atari_more(false);
-
-                if (liberty == 1)
-                {
-                    reqv2.add_capture_size_one(stoneCount == 1);
-                    reqv2.add_capture_size_two(stoneCount == 2);
-                    reqv2.add_capture_size_three(stoneCount == 3);
-                    reqv2.add_capture_size_four(stoneCount == 4);
-                    reqv2.add_capture_size_five(stoneCount == 5);
-                    reqv2.add_capture_size_six(stoneCount == 6);
-                    reqv2.add_capture_size_seven(stoneCount == 7);
-                    reqv2.add_capture_size_more(stoneCount >= 8);
-                }
-                else
-                {
-                    reqv2.add_capture_size_one(false);
-                    reqv2.add_capture_size_two(false);
-                    reqv2.add_capture_size_three(false);
-                    reqv2.add_capture_size_four(false);
-                    reqv2.add_capture_size_five(false);
-                    reqv2.add_capture_size_six(false);
-                    reqv2.add_capture_size_seven(false);
-                    reqv2.add_capture_size_more(false);
-                }
+                std::uint16_t half = floatToHalf(possibility[i]);
+                out[i * 2] = static_cast<char>(half & 0xff);
+                out[i * 2 + 1] = static_cast<char>(half >> 8);
             }
+    }
 
-            reqv2.add_turns_since_one(p == lastOnePlace);
-            reqv2.add_turns_since_two(p == lastTwoPlace);
-            reqv2.add_turns_since_three(p == lastThreePlace);
-            reqv2.add_turns_since_four(p == lastFourPlace);
-            reqv2.add_turns_since_five(p == lastFivePlace);
-            reqv2.add_turns_since_six(p == lastSixPlace);
-            reqv2.add_turns_since_seven(p == lastSevenPlace);
-            if (!isEmpty && !(p == lastOnePlace ||
-                    p == lastTwoPlace ||
-                    p == lastThreePlace ||
-                    p == lastFourPlace ||
-                    p == lastFivePlace ||
-                    p == lastSixPlace ||
-                    p == lastSevenPlace))
-                reqv2.add_turns_since_more(true);
-            else
-                reqv2.add_turns_since_more(false);
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::unpackPossibility(const char *packed, gocnn::ResponseV3::Encoding encoding, float *possibility)
+    {
+        for (std::size_t i = 0; i < W * H; ++i)
+            possibility[i] = encoding == gocnn::ResponseV3::UINT8 ?
+                             static_cast<std::uint8_t>(packed[i]) / 255.0f :
+                             halfToFloat(static_cast<std::uint16_t>(static_cast<std::uint8_t>(packed[i * 2]) |
+                                                                    static_cast<std::uint8_t>(packed[i * 2 + 1]) << 8));
+    }
 
-            reqv2.add_sensibleness(isTrueEye(p, player));
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestV3(Player player, FeatureSet set) const -> gocnn::RequestV3
+    {
+        std::size_t planeCnt = getPackedPlaneCount(set);
+        gocnn::RequestV3 req;
+        req.set_board_size(W * H);
+        req.set_feature_set(toMessageFeatureSet(set));
+        req.set_plane_count(planeCnt);
+        std::string &planes = *req.mutable_planes();
+        planes.resize(planeCnt * PACKED_PLANE_BYTES);
+        packFeatures(player, set, &planes[0]);
+        return req;
+    }
 
-            reqv2.add_ko(koPlayer == player && koPoint == p);
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::decodeRequestV3(const gocnn::RequestV3 &req, float *out)
+    {
+        std::size_t planeCnt = static_cast<std::size_t>(req.plane_count());
+        if (req.board_size() != static_cast<int>(W * H) || req.planes().size() != planeCnt * PACKED_PLANE_BYTES)
+            throw std::runtime_error("RequestV3 doesn't match size of board");
+        unpackFeatures(req.planes().data(), planeCnt, req.feature_set() != gocnn::FEATURE_SET_V1, out);
+    }
 
-            reqv2.add_border(p.is_left() || p.is_top() || p.is_right() || p.is_bottom());
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::encodeResponseV3(const float *possibility, gocnn::ResponseV3::Encoding encoding)
+        -> gocnn::ResponseV3
+    {
+        gocnn::ResponseV3 resp;
+        resp.set_board_size(W * H);
+        resp.set_encoding(encoding);
+        std::string &bytes = *resp.mutable_possibility();
+        bytes.resize(W * H * getPossibilityBytes(encoding));
+        packPossibility(possibility, encoding, &bytes[0]);
+        return resp;
+    }
 
-            reqv2.add_position(exp(-0.5 * (pow((double)p.x - (double)(H - 1) / 2.0, 2) + pow((double)p.y - (double)(W - 1) / 2.0, 2))));
-        });
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::decodeResponseV3(const gocnn::ResponseV3 &resp, float *possibility)
+    {
+        if (resp.board_size() != static_cast<int>(W * H) ||
+                resp.possibility().size() != W * H * getPossibilityBytes(resp.encoding()))
+            throw std::runtime_error("ResponseV3 doesn't match size of board");
+        unpackPossibility(resp.possibility().data(), resp.encoding(), possibility);
+    }
 
-        return reqv2;
+    template<std::size_t W, std::size_t H>
+    auto Board<W, H>::generateRequestBatch(const std::vector<std::pair<const Board *, Player>> &positions,
+                                           FeatureSet set) -> gocnn::RequestBatch
+    {
+        std::size_t planeCnt = getPackedPlaneCount(set);
+        gocnn::RequestBatch req;
+        req.set_board_size(W * H);
+        req.set_feature_set(toMessageFeatureSet(set));
+        req.set_plane_count(planeCnt);
+        req.set_batch_size(positions.size());
+        std::string &planes = *req.mutable_planes();
+        planes.resize(positions.size() * planeCnt * PACKED_PLANE_BYTES);
+        for (std::size_t i = 0; i < positions.size(); ++i)
+            positions[i].first->packFeatures(positions[i].second, set, &planes[i * planeCnt * PACKED_PLANE_BYTES]);
+        return req;
     }
 
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::decodeRequestBatch(const gocnn::RequestBatch &req, std::size_t i, float *out)
+    {
+        std::size_t planeCnt = static_cast<std::size_t>(req.plane_count());
+        std::size_t batchSize = static_cast<std::size_t>(req.batch_size());
+        if (req.board_size() != static_cast<int>(W * H) || i >= batchSize ||
+                req.planes().size() != batchSize * planeCnt * PACKED_PLANE_BYTES)
+            throw std::runtime_error("RequestBatch doesn't match size of board");
+        unpackFeatures(req.planes().data() + i * planeCnt * PACKED_PLANE_BYTES, planeCnt,
+                       req.feature_set() != gocnn::FEATURE_SET_V1, out);
+    }
 
     template<std::size_t W, std::size_t H>
-    auto Board<W, H>::generateRequestV2Bug(Player player) -> gocnn::RequestV2
+    auto Board<W, H>::encodeResponseBatch(const float *possibility, std::size_t batchSize,
+                                          gocnn::ResponseV3::Encoding encoding) -> gocnn::ResponseBatch
     {
-        gocnn::RequestV2 reqV2 = generateRequestV2(player);
-        std::fill(reqV2.mutable_turns_since_one()->begin(), reqV2.mutable_turns_since_one()->end(), false);
-        std::fill(reqV2.mutable_turns_since_two()->begin(), reqV2.mutable_turns_since_two()->end(), false);
-        std::fill(reqV2.mutable_turns_since_three()->begin(), reqV2.mutable_turns_since_three()->end(), false);
-        std::fill(reqV2.mutable_turns_since_four()->begin(), reqV2.mutable_turns_since_four()->end(), false);
-        std::fill(reqV2.mutable_turns_since_five()->begin(), reqV2.mutable_turns_since_five()->end(), false);
-        std::fill(reqV2.mutable_turns_since_six()->begin(), reqV2.mutable_turns_since_six()->end(), false);
-        std::fill(reqV2.mutable_turns_since_seven()->begin(), reqV2.mutable_turns_since_seven()->end(), false);
-        std::fill(reqV2.mutable_turns_since_more()->begin(), reqV2.mutable_turns_since_more()->end(), true);
-        return reqV2;
-    };
+        gocnn::ResponseBatch resp;
+        resp.set_board_size(W * H);
+        resp.set_encoding(encoding);
+        resp.set_batch_size(batchSize);
+        std::string &bytes = *resp.mutable_possibility();
+        bytes.resize(batchSize * W * H * getPossibilityBytes(encoding));
+        for (std::size_t i = 0; i < batchSize; ++i)
+            packPossibility(possibility + i * W * H, encoding, &bytes[i * W * H * getPossibilityBytes(encoding)]);
+        return resp;
+    }
+
+    template<std::size_t W, std::size_t H>
+    void Board<W, H>::decodeResponseBatch(const gocnn::ResponseBatch &resp, std::size_t i, float *possibility)
+    {
+        std::size_t batchSize = static_cast<std::size_t>(resp.batch_size());
+        std::size_t bytes = W * H * getPossibilityBytes(resp.encoding());
+        if (resp.board_size() != static_cast<int>(W * H) || i >= batchSize ||
+                resp.possibility().size() != batchSize * bytes)
+            throw std::runtime_error("ResponseBatch doesn't match size of board");
+        unpackPossibility(resp.possibility().data() + i * bytes, resp.encoding(), possibility);
+    }
 
     template<std::size_t W, std::size_t H>
     double Board<W, H>::getPointScore(PointType p, Player player) const
@@ -1040,7 +2017,8 @@ namespace board
         double border_score = 0;
         const double border_score_weight = 0.1;
 
-        if (p.is_left() || p.is_top() || p.is_right() || p.is_bottom())
+        const PointTables &tables = pointTables();
+        if (tables.border[pointToIndex(p)])
             border_score = 0;
         else
             border_score = 100;
@@ -1048,17 +2026,21 @@ namespace board
         double position_score = 0;
         const double position_score_weight = 0.0;
 
-        position_score = 100 * (1 - std::min(std::min(abs(p.x - 3.0), abs(p.x - 15.0)), std::min(abs(p.y - 3.0), abs(p.y - 15.0))) / 7.0);
+        position_score = tables.positionScore[pointToIndex(p)];
 
         double liberty_score = 0;
         const double liberty_score_weight = 0.2;
 
         int min_liberty = 361;
-        p.for_each_adjacent([&](PointType adjP) {
-            hasOurs = hasOurs || getPointState(adjP) == getPointStateFromPlayer(player);
-            hasOppo = hasOppo || getPointState(adjP) == getPointStateFromPlayer(getOpponentPlayer(player));
-            GroupConstIterator group = getPointGroup(adjP);
-            min_liberty = std::min(min_liberty, (int)group->getLiberty());
+        PointState ourState = getPointStateFromPlayer(player);
+        PointState oppoState = getPointStateFromPlayer(getOpponentPlayer(player));
+        forEachAdjacent_(p, [&](PointType adjP, PointState adjState) {
+            if (adjState == LayoutType::BORDER)
+                return;
+            hasOurs = hasOurs || adjState == ourState;
+            hasOppo = hasOppo || adjState == oppoState;
+            // An empty neighbour has NO_GROUP, whose node counts no liberty
+            min_liberty = std::min(min_liberty, (int)groups_[getPointGroup_(adjP)].getLiberty());
         });
         if (min_liberty < 361)
             liberty_score = std::max(6 - min_liberty, 0) * 100 / 5.0;
@@ -1078,7 +2060,8 @@ namespace board
         {
             candidate_center = history.front();
             history.pop();
-            dis = pow((double)p.x - (double)candidate_center.x, 2) + pow((double)p.y - (double)candidate_center.y, 2);
+            int dx = p.x - candidate_center.x, dy = p.y - candidate_center.y;
+            dis = dx * dx + dy * dy;
             if (dis <= 18)
             {
                 nearby_score = nearby_base_score * (36 - dis) / 36.0;
@@ -1122,12 +2105,9 @@ namespace std
     template<std::size_t W, std::size_t H>
     struct hash<board::Board<W, H>>
     {
-    private:
-        hash<board::BoardGrid<W, H>> h;
-    public:
         std::size_t operator() (const board::Board<W, H> &b) const
         {
-            return h(b.boardGrid_);
+            return static_cast<std::size_t>(b.getPositionHash());
         }
     };
 }
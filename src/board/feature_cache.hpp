@@ -0,0 +1,101 @@
+#ifndef GO_AI_FEATURE_CACHE_HPP
+#define GO_AI_FEATURE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include "basic.hpp"
+#include "board_class.hpp"
+
+namespace board
+{
+    // Feature planes of a Board for both players, as Board::writeFeaturePlanes() writes them to uint8_t in NCHW,
+    // kept up to date across moves. After each place(), update() rewrites only the points the move may have changed,
+    // so following a game or a search line costs time proportional to the change rather than to the board.
+    template<std::size_t W, std::size_t H>
+    class FeatureCache
+    {
+    public:
+        using BoardType = Board<W, H>;
+        using PointType = typename BoardType::PointType;
+        using FeatureSet = typename BoardType::FeatureSet;
+    private:
+        FeatureSet set_;
+        std::size_t planeCnt_;
+        std::array<std::vector<std::uint8_t>, 2> planes_; // indexed by Player
+        bool synced_ = false;
+        std::size_t step_ = 0, stateHash_ = 0; // of the board planes_ show
+        // History and ko point planes_ show, which have to be rewritten when they change
+        typename BoardType::HistoryArray history_;
+        std::size_t historySize_ = 0;
+        PointType koPoint_ = {-1, -1};
+
+        void writePoint(const BoardType &b, PointType p, const typename BoardType::HistoryArray &history,
+                        std::size_t historySize)
+        {
+            std::size_t idx = BoardType::pointToIndex(p);
+            for (Player player: {Player::W, Player::B})
+            {
+                std::uint8_t *out = planes_[static_cast<std::size_t>(player)].data();
+                for (std::size_t plane = 0; plane < planeCnt_; ++plane)
+                    out[plane * W * H + idx] = 0;
+                b.forEachPointFeature(player, set_, p, history, historySize, [&](std::size_t plane, float value) {
+                    out[plane * W * H + idx] = set_ != FeatureSet::V1 && plane == BoardType::FEATURE_V2_POSITION_PLANE ?
+                                               static_cast<std::uint8_t>(value * 255.0f + 0.5f) :
+                                               static_cast<std::uint8_t>(value);
+                });
+            }
+        }
+    public:
+        explicit FeatureCache(FeatureSet set = FeatureSet::V2):
+                set_(set), planeCnt_(BoardType::getFeaturePlaneCount(set))
+        {
+            for (std::vector<std::uint8_t> &planes: planes_)
+                planes.assign(planeCnt_ * W * H, 0);
+        }
+
+        // Bring planes up to date with b. Incremental when b is exactly one place() ahead of the board last seen,
+        // made with change tracking on, otherwise everything is rewritten. Returns whether it was incremental.
+        bool update(const BoardType &b)
+        {
+            typename BoardType::HistoryArray history {};
+            std::size_t historySize = b.getFeatureHistory(set_, history);
+            bool incremental = synced_ && b.lastChangedValid_ && b.step_ == step_ + 1 && b.lastStateHash_ == stateHash_;
+            if (incremental)
+            {
+                b.lastChanged_.forEach([&](PointType p) {
+                    writePoint(b, p, history, historySize);
+                });
+                for (std::size_t i = 0; i < historySize_; ++i)
+                    writePoint(b, history_[i], history, historySize);
+                if (koPoint_ != PointType(-1, -1))
+                    writePoint(b, koPoint_, history, historySize);
+            }
+            else
+                PointType::for_all([&](PointType p) {
+                    writePoint(b, p, history, historySize);
+                });
+
+            synced_ = true;
+            step_ = b.step_;
+            stateHash_ = b.curStateHash_;
+            history_ = history;
+            historySize_ = historySize;
+            koPoint_ = b.koPoint;
+            return incremental;
+        }
+
+        // getFeaturePlaneCount(set) * W * H values, for player to move
+        const std::uint8_t *data(Player player) const
+        {
+            return planes_[static_cast<std::size_t>(player)].data();
+        }
+        std::size_t size() const
+        {
+            return planeCnt_ * W * H;
+        }
+    };
+}
+#endif //GO_AI_FEATURE_CACHE_HPP
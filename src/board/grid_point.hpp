@@ -7,11 +7,45 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <vector>
+#include <array>
 #include <compressed_grid.hpp>
 
 namespace board
 {
+    // At most N points, kept inline so that returning it by value never allocates.
+    // Iterated and indexed like the std::vector neighbour lists of GridPoint used to be.
+    template<typename PT, std::size_t N>
+    struct PointList
+    {
+        std::array<PT, N> points;
+        std::size_t cnt = 0;
+
+        void push_back(PT p)
+        {
+            points[cnt++] = p;
+        }
+        std::size_t size() const
+        {
+            return cnt;
+        }
+        bool empty() const
+        {
+            return cnt == 0;
+        }
+        PT operator[](std::size_t i) const
+        {
+            return points[i];
+        }
+        const PT *begin() const
+        {
+            return points.data();
+        }
+        const PT *end() const
+        {
+            return points.data() + cnt;
+        }
+    };
+
     template<std::size_t W, std::size_t H>
     struct GridPoint: public compgrid::GridPoint<W, H>
     {
@@ -116,13 +150,10 @@ namespace board
             if (!this->is_right()) f(right_point());
             if (!this->is_bottom()) f(down_point());
         }
-        std::vector<GridPoint> get_adjacent_point() const
+        PointList<GridPoint, 4> get_adjacent_point() const
         {
-            std::vector<GridPoint> v;
-            if (!this->is_left()) v.push_back(left_point());
-            if (!this->is_top()) v.push_back(up_point());
-            if (!this->is_right()) v.push_back(right_point());
-            if (!this->is_bottom()) v.push_back(down_point());
+            PointList<GridPoint, 4> v;
+            for_each_adjacent([&](GridPoint p) { v.push_back(p); });
             return v;
         }
         template<typename FT>
@@ -133,13 +164,10 @@ namespace board
             if (!this->is_right() && !this->is_top()) f(right_up_point());
             if (!this->is_right() && !this->is_bottom()) f(right_down_point());
         }
-        std::vector<GridPoint> get_diag_point() const
+        PointList<GridPoint, 4> get_diag_point() const
         {
-            std::vector<GridPoint> v;
-            if (!this->is_left() && !this->is_top()) v.push_back(left_up_point());
-            if (!this->is_left() && !this->is_bottom()) v.push_back(left_down_point());
-            if (!this->is_right() && !this->is_top()) v.push_back(right_up_point());
-            if (!this->is_right() && !this->is_bottom()) v.push_back(right_down_point());
+            PointList<GridPoint, 4> v;
+            for_each_diag([&](GridPoint p) { v.push_back(p); });
             return v;
         }
         template<typename FT>
@@ -154,17 +182,10 @@ namespace board
             if (!this->is_right() && !this->is_top()) f(right_up_point());
             if (!this->is_right() && !this->is_bottom()) f(right_down_point());
         }
-        std::vector<GridPoint> get_wrap8_point() const
-        {
-            std::vector<GridPoint> v;
-            if (!this->is_left()) v.push_back(left_point());
-            if (!this->is_top()) v.push_back(up_point());
-            if (!this->is_right()) v.push_back(right_point());
-            if (!this->is_bottom()) v.push_back(down_point());
-            if (!this->is_left() && !this->is_top()) v.push_back(left_up_point());
-            if (!this->is_left() && !this->is_bottom()) v.push_back(left_down_point());
-            if (!this->is_right() && !this->is_top()) v.push_back(right_up_point());
-            if (!this->is_right() && !this->is_bottom()) v.push_back(right_down_point());
+        PointList<GridPoint, 8> get_wrap8_point() const
+        {
+            PointList<GridPoint, 8> v;
+            for_each_wrap8([&](GridPoint p) { v.push_back(p); });
             return v;
         }
         bool operator ==(const GridPoint &other) const
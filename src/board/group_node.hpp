@@ -7,38 +7,47 @@
 
 #include <climits>
 #include <cstdint>
-#include <compressed_grid.hpp>
 #include "basic.hpp"
+#include "grid_point.hpp"
 
 namespace board
 {
+    // Only counts are kept, so that the pool of nodes stays small. Board finds which points are liberties
+    // from the stones of the group
     template<std::size_t W, std::size_t H>
     struct GroupNode
     {
     public:
-        using CGType = compgrid::CompressedGrid<bool, W, H, 1>;
-        using PointType = typename CGType::PointType;
+        using PointType = GridPoint<W, H>;
     private:
         Player player;
-        CGType liberty_grid;
+        std::size_t liberty_cnt;
         std::size_t stone_cnt;
+        PointType head; // Any stone of this group. Other stones are reached through Board's stone chain
     public:
         GroupNode() = default;
-        explicit GroupNode(Player p, std::size_t stone_cnt = 1, const CGType &cg = CGType()):
-                player(p), liberty_grid(cg), stone_cnt(stone_cnt)
+        explicit GroupNode(Player p, std::size_t stone_cnt = 1, std::size_t liberty_cnt = 0):
+                player(p), liberty_cnt(liberty_cnt), stone_cnt(stone_cnt)
         {}
+        // O(1), the count is kept up to date by addLiberty(), removeLiberty() and merge()
         std::size_t getLiberty() const
         {
-            return liberty_grid.count();
+            return liberty_cnt;
         }
-        // set a position is/is not controlled by this group
-        void setLiberty(typename CGType::PointType point, bool value)
+        bool isInAtari() const
         {
-            liberty_grid.set(point, value);
+            return liberty_cnt == 1;
         }
-        void addLiberty(int libDelta)
+        // An empty point next to the group became its liberty. To be called once per point,
+        // however many stones of the group it touches
+        void addLiberty()
         {
-            libDelta += libDelta;
+            ++liberty_cnt;
+        }
+        // A liberty of the group was filled. To be called once per point, as addLiberty()
+        void removeLiberty()
+        {
+            --liberty_cnt;
         }
         Player getPlayer() const
         {
@@ -49,11 +58,12 @@ namespace board
             player = p;
         }
 
-        void merge(const GroupNode &other)
+        // sharedLiberty: number of liberties both groups have, which the union counts once
+        void merge(const GroupNode &other, std::size_t sharedLiberty)
         {
             if (&other != this)
             {
-                liberty_grid |= other.liberty_grid;
+                liberty_cnt += other.liberty_cnt - sharedLiberty;
                 stone_cnt += other.stone_cnt;
             }
         }
@@ -62,6 +72,15 @@ namespace board
         {
             return stone_cnt;
         }
+
+        PointType getHead() const
+        {
+            return head;
+        }
+        void setHead(PointType p)
+        {
+            head = p;
+        }
     };
 }
 #endif //GO_AI_GROUP_NODE_HPP
@@ -0,0 +1,151 @@
+#ifndef GO_AI_GROUP_POOL_HPP
+#define GO_AI_GROUP_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <iterator>
+#include <cassert>
+#include "basic.hpp"
+#include "group_node.hpp"
+
+namespace board
+{
+    // Fixed-capacity storage of GroupNode indexed by GroupId, with a free list of ids.
+    // There can't be more groups than points, so W * H nodes always suffice.
+    // A free node is a default GroupNode(0 stone). Node NONE is never allocated and stays empty,
+    // so that looking up the group of an empty point is always safe.
+    template<std::size_t W, std::size_t H>
+    class GroupPool
+    {
+    public:
+        using GroupNodeType = GroupNode<W, H>;
+        static const GroupId CAPACITY = W * H;
+        static const GroupId NONE = W * H;
+        static_assert(W * H < 0x8000, "GroupId can't hold all groups of such board");
+
+        class const_iterator
+        {
+            const GroupPool *pool_ = nullptr;
+            GroupId id_ = NONE;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = GroupNodeType;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const GroupNodeType *;
+            using reference = const GroupNodeType &;
+
+            const_iterator() = default;
+            const_iterator(const GroupPool *pool, GroupId id): pool_(pool), id_(id) {}
+
+            GroupId id() const
+            {
+                return id_;
+            }
+            reference operator*() const
+            {
+                return pool_->nodes_[id_];
+            }
+            pointer operator->() const
+            {
+                return &pool_->nodes_[id_];
+            }
+            // Walks through allocated groups, in order of id
+            const_iterator &operator++()
+            {
+                do
+                    ++id_;
+                while (id_ < CAPACITY && pool_->nodes_[id_].getStoneCnt() == 0);
+                return *this;
+            }
+            const_iterator operator++(int)
+            {
+                const_iterator old = *this;
+                ++*this;
+                return old;
+            }
+            bool operator==(const const_iterator &other) const
+            {
+                return id_ == other.id_ && pool_ == other.pool_;
+            }
+            bool operator!=(const const_iterator &other) const
+            {
+                return !(*this == other);
+            }
+        };
+
+    private:
+        std::array<GroupNodeType, CAPACITY + 1> nodes_;
+        std::array<GroupId, CAPACITY> freeIds_; // stack of free ids
+        GroupId freeCnt_;
+
+    public:
+        GroupPool()
+        {
+            clear();
+        }
+        void clear()
+        {
+            nodes_.fill(GroupNodeType());
+            // ids are handed out from 0
+            for (GroupId i = 0; i < CAPACITY; ++i)
+                freeIds_[i] = CAPACITY - 1 - i;
+            freeCnt_ = CAPACITY;
+        }
+
+        GroupNodeType &operator[](GroupId id)
+        {
+            return nodes_[id];
+        }
+        const GroupNodeType &operator[](GroupId id) const
+        {
+            return nodes_[id];
+        }
+
+        GroupId alloc(const GroupNodeType &node)
+        {
+            assert(freeCnt_ > 0);
+            GroupId id = freeIds_[--freeCnt_];
+            nodes_[id] = node;
+            return id;
+        }
+        void free(GroupId id)
+        {
+            nodes_[id] = GroupNodeType();
+            freeIds_[freeCnt_++] = id;
+        }
+        // Revert the latest alloc(), which returned id
+        void revertAlloc(GroupId id)
+        {
+            free(id);
+        }
+        // Revert the latest free(id). Content of the node has to be restored by caller
+        void revertFree(GroupId id)
+        {
+            assert(freeCnt_ > 0 && freeIds_[freeCnt_ - 1] == id);
+            (void)id; // Only checked by the assert
+            --freeCnt_;
+        }
+
+        std::size_t size() const
+        {
+            return CAPACITY - freeCnt_;
+        }
+        const_iterator iteratorOf(GroupId id) const
+        {
+            return const_iterator(this, id);
+        }
+        const_iterator begin() const
+        {
+            GroupId id = 0;
+            while (id < CAPACITY && nodes_[id].getStoneCnt() == 0)
+                ++id;
+            return const_iterator(this, id < CAPACITY ? id : NONE);
+        }
+        const_iterator end() const
+        {
+            return const_iterator(this, NONE);
+        }
+    };
+}
+#endif //GO_AI_GROUP_POOL_HPP
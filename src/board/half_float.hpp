@@ -0,0 +1,66 @@
+#ifndef GO_AI_HALF_FLOAT_HPP
+#define GO_AI_HALF_FLOAT_HPP
+
+#include <cstdint>
+#include <cstring>
+
+namespace board
+{
+    // IEEE 754 half precision <-> float, rounding to nearest even
+    inline std::uint16_t floatToHalf(float value)
+    {
+        std::uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        std::uint16_t sign = static_cast<std::uint16_t>((f >> 16) & 0x8000);
+        std::uint32_t absF = f & 0x7fffffff;
+        if (absF >= 0x7f800000) // inf or nan
+            return sign | 0x7c00 | (absF > 0x7f800000 ? 0x200 : 0);
+        if (absF >= 0x477ff000) // rounds to more than the largest half
+            return sign | 0x7c00;
+        if (absF < 0x38800000) // subnormal half, or 0
+        {
+            if (absF < 0x33000000)
+                return sign;
+            std::uint32_t mantissa = (absF & 0x7fffff) | 0x800000;
+            std::uint32_t shift = 126 - (absF >> 23); // 14..24
+            std::uint32_t half = mantissa >> shift;
+            std::uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return sign | static_cast<std::uint16_t>(half);
+        }
+        std::uint32_t half = ((absF >> 13) - (112 << 10)); // rebias exponent from 127 to 15
+        std::uint32_t rest = absF & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;
+        return sign | static_cast<std::uint16_t>(half);
+    }
+
+    inline float halfToFloat(std::uint16_t half)
+    {
+        std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000) << 16;
+        std::uint32_t exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff;
+        std::uint32_t f;
+        if (exponent == 0x1f)
+            f = sign | 0x7f800000 | (mantissa << 13);
+        else if (exponent != 0)
+            f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        else if (mantissa == 0)
+            f = sign;
+        else
+        {
+            // subnormal: normalize the mantissa
+            exponent = 113;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+    }
+}
+#endif //GO_AI_HALF_FLOAT_HPP
@@ -0,0 +1,164 @@
+#ifndef GO_AI_HASH_HISTORY_HPP
+#define GO_AI_HASH_HISTORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace board
+{
+    inline constexpr std::size_t nextPowerOf2(std::size_t n, std::size_t p = 1)
+    {
+        return p >= n ? p : nextPowerOf2(n, p * 2);
+    }
+
+    // Set of the latest MAX_SIZE position hashes. Once full, each insert forgets the oldest hash,
+    // and undoInsert() brings it back, so the set is always exactly the latest MAX_SIZE hashes inserted.
+    // A hash inserted again counts as new, so one repeated within MAX_SIZE inserts is never forgotten.
+    // Hashes are kept in order of their latest insert in a ring buffer, indexed by an open addressing table
+    // with linear probing.
+    // Capacity must be a power of 2, and at most Capacity / 2 hashes are kept so that probing stays short.
+    template<std::size_t Capacity>
+    class HashHistory
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity of HashHistory must be a power of 2");
+        static_assert(Capacity / 2 < 65536, "Indices of HashHistory are stored in 16 bits");
+    public:
+        static const std::size_t MAX_SIZE = Capacity / 2;
+
+        // What an insert() did, for undoInsert()
+        struct InsertRecord
+        {
+            bool inserted = false; // false if the hash was there already
+            bool evicted = false;
+            std::uint64_t evictedHash = 0; // the oldest hash, forgotten to make room
+            bool refreshed = false; // the hash was there already, and was moved from age refreshedAge to the newest
+            std::size_t refreshedAge = 0; // 0 for the oldest
+        };
+    private:
+        std::array<std::uint64_t, MAX_SIZE> hashes_ {}; // ring buffer, the oldest at begin_
+        std::array<std::uint16_t, Capacity> table_ {}; // 1 + index into hashes_. 0 marks an empty slot
+        std::size_t begin_ = 0, size_ = 0;
+
+        static std::size_t home(std::uint64_t hash)
+        {
+            return static_cast<std::size_t>(hash) & (Capacity - 1);
+        }
+        // Slot of table_ pointing at hash, or the empty slot where it would go
+        std::size_t probe(std::uint64_t hash) const
+        {
+            std::size_t idx = home(hash);
+            while (table_[idx] != 0 && hashes_[table_[idx] - 1] != hash)
+                idx = (idx + 1) & (Capacity - 1);
+            return idx;
+        }
+        void link(std::size_t pos)
+        {
+            table_[probe(hashes_[pos])] = static_cast<std::uint16_t>(pos + 1);
+        }
+        // Move the hash at pos to to, which no slot of table_ points at
+        void relocate(std::size_t pos, std::size_t to)
+        {
+            std::size_t idx = probe(hashes_[pos]);
+            hashes_[to] = hashes_[pos];
+            table_[idx] = static_cast<std::uint16_t>(to + 1);
+        }
+        std::size_t at(std::size_t age) const
+        {
+            return (begin_ + age) % MAX_SIZE;
+        }
+        // Remove the slot of hashes_[pos], shifting later slots of its probe run back so that none is cut off
+        void unlink(std::size_t pos)
+        {
+            std::size_t gap = probe(hashes_[pos]);
+            table_[gap] = 0;
+            for (std::size_t idx = (gap + 1) & (Capacity - 1); table_[idx] != 0; idx = (idx + 1) & (Capacity - 1))
+            {
+                // The slot may fill the gap unless its home lies after the gap
+                std::size_t dist = (idx - home(hashes_[table_[idx] - 1])) & (Capacity - 1);
+                if (dist >= ((idx - gap) & (Capacity - 1)))
+                {
+                    table_[gap] = table_[idx];
+                    table_[idx] = 0;
+                    gap = idx;
+                }
+            }
+        }
+    public:
+        std::size_t size() const
+        {
+            return size_;
+        }
+        void clear()
+        {
+            table_.fill(0);
+            begin_ = size_ = 0;
+        }
+        bool contains(std::uint64_t hash) const
+        {
+            return table_[probe(hash)] != 0;
+        }
+        // Remember hash, forgetting the oldest hash if MAX_SIZE are kept.
+        // A hash already kept is made the newest instead, moving the newer ones down: O(size()), but only on repeats
+        InsertRecord insert(std::uint64_t hash)
+        {
+            InsertRecord record;
+            std::size_t idx = probe(hash);
+            if (table_[idx] != 0)
+            {
+                std::size_t age = (table_[idx] - 1 + MAX_SIZE - begin_) % MAX_SIZE;
+                record.refreshed = true;
+                record.refreshedAge = age;
+                unlink(at(age));
+                for (std::size_t i = age + 1; i < size_; ++i)
+                    relocate(at(i), at(i - 1));
+                hashes_[at(size_ - 1)] = hash;
+                link(at(size_ - 1));
+                return record;
+            }
+            if (size_ == MAX_SIZE)
+            {
+                record.evicted = true;
+                record.evictedHash = hashes_[begin_];
+                unlink(begin_);
+                begin_ = (begin_ + 1) % MAX_SIZE;
+                --size_;
+            }
+            std::size_t pos = (begin_ + size_) % MAX_SIZE;
+            hashes_[pos] = hash;
+            link(pos);
+            ++size_;
+            record.inserted = true;
+            return record;
+        }
+        // Revert the latest insert(), which returned record
+        void undoInsert(const InsertRecord &record)
+        {
+            if (record.refreshed)
+            {
+                std::uint64_t hash = hashes_[at(size_ - 1)];
+                unlink(at(size_ - 1));
+                for (std::size_t i = size_ - 1; i-- > record.refreshedAge; )
+                    relocate(at(i), at(i + 1));
+                hashes_[at(record.refreshedAge)] = hash;
+                link(at(record.refreshedAge));
+                return;
+            }
+            if (!record.inserted)
+                return;
+            unlink((begin_ + size_ - 1) % MAX_SIZE);
+            --size_;
+            if (record.evicted)
+            {
+                begin_ = (begin_ + MAX_SIZE - 1) % MAX_SIZE;
+                hashes_[begin_] = record.evictedHash;
+                link(begin_);
+                ++size_;
+            }
+        }
+    };
+
+    template<std::size_t Capacity>
+    const std::size_t HashHistory<Capacity>::MAX_SIZE;
+}
+#endif //GO_AI_HASH_HISTORY_HPP
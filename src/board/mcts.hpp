@@ -0,0 +1,353 @@
+#ifndef GO_AI_MCTS_HPP
+#define GO_AI_MCTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include "basic.hpp"
+#include "board_class.hpp"
+#include "playout.hpp"
+
+namespace board
+{
+    // Monte-Carlo tree search with PUCT selection, shared by several threads without locks.
+    // Nodes live in an arena allocated once, children of a node being a contiguous block of it.
+    // Statistics of a node are atomic counters. A thread descending through a node adds a virtual loss to it,
+    // which steers other threads to other branches until the result is backed up.
+    template<std::size_t W, std::size_t H>
+    class MCTS
+    {
+    public:
+        using BoardType = Board<W, H>;
+        using PointType = typename BoardType::PointType;
+        using PlayoutType = Playout<W, H>;
+        // Fill priors[i] with how promising moves[i] of player on b looks. Any non-negative scale will do,
+        // priors of a node are normalised afterwards.
+        using PriorFunction = std::function<void(const BoardType &b, Player player,
+                                                 const PointType *moves, std::size_t moveCnt, float *priors)>;
+        // Fill possibility[x * W + y] for player to move on b, e.g. by decodeResponseV3() of a network response
+        using PossibilityFunction = std::function<void(const BoardType &b, Player player, float *possibility)>;
+
+        static const PointType PASS; // move of a pass node, (-1, -1)
+
+        struct MoveStat
+        {
+            PointType move;
+            std::size_t visits;
+            double winRate; // for the player who makes the move
+            float prior;
+        };
+    private:
+        enum : std::uint8_t
+        {
+            UNEXPANDED, EXPANDING, EXPANDED,
+            LEAF // No room left in the arena for its children
+        };
+        static const std::uint32_t NO_CHILD = 0xffffffffu;
+        struct Node
+        {
+            std::atomic<std::uint32_t> visits;
+            std::atomic<std::uint32_t> virtualLoss;
+            std::atomic<std::uint32_t> halfWins; // 2 per win and 1 per draw of the player who made move
+            std::atomic<std::uint32_t> firstChild;
+            std::atomic<std::uint16_t> childCnt;
+            std::atomic<std::uint8_t> state;
+            PointType move;
+            float prior;
+
+            void reset(PointType m, float p)
+            {
+                visits.store(0, std::memory_order_relaxed);
+                virtualLoss.store(0, std::memory_order_relaxed);
+                halfWins.store(0, std::memory_order_relaxed);
+                firstChild.store(NO_CHILD, std::memory_order_relaxed);
+                childCnt.store(0, std::memory_order_relaxed);
+                state.store(UNEXPANDED, std::memory_order_relaxed);
+                move = m;
+                prior = p;
+            }
+        };
+
+        std::size_t threadCnt_;
+        std::size_t capacity_;
+        std::unique_ptr<Node[]> nodes_;
+        std::atomic<std::size_t> used_;
+        double komi_;
+        std::uint64_t seed_;
+        float exploration_ = 1.5f;
+        std::uint32_t virtualLossWeight_ = 3;
+        PriorFunction prior_;
+        Player rootPlayer_ = Player::B;
+        std::atomic<std::size_t> started_;
+
+        // Reserve cnt nodes. NO_CHILD if the arena is full
+        std::uint32_t allocNodes(std::size_t cnt)
+        {
+            std::size_t first = used_.fetch_add(cnt, std::memory_order_relaxed);
+            return first + cnt <= capacity_ ? static_cast<std::uint32_t>(first) : NO_CHILD;
+        }
+
+        // Create children of node for player to move on b. node must be in state EXPANDING, which this thread owns
+        void expand(Node &node, const BoardType &b, Player player)
+        {
+            std::array<PointType, W * H> moves;
+            std::array<float, W * H> priors;
+            std::size_t moveCnt = 0;
+            b.getLegalSet(player).forEach([&](PointType p) {
+                if (!b.isTrueEye(p, player) && !b.isSelfAtari(p, player) &&
+                        (!b.isSuperkoEnabled() || !b.isSuperko(p, player)))
+                    moves[moveCnt++] = p;
+            });
+            if (moveCnt == 0)
+            {
+                moves[0] = PASS;
+                priors[0] = 1;
+                moveCnt = 1;
+            }
+            else
+            {
+                prior_(b, player, moves.data(), moveCnt, priors.data());
+                float sum = 0;
+                for (std::size_t i = 0; i < moveCnt; ++i)
+                    sum += priors[i] = std::max(priors[i], 0.0f);
+                for (std::size_t i = 0; i < moveCnt; ++i)
+                    priors[i] = sum > 0 ? priors[i] / sum : 1.0f / moveCnt;
+            }
+
+            std::uint32_t first = allocNodes(moveCnt);
+            if (first == NO_CHILD)
+            {
+                node.state.store(LEAF, std::memory_order_release);
+                return;
+            }
+            for (std::size_t i = 0; i < moveCnt; ++i)
+                nodes_[first + i].reset(moves[i], priors[i]);
+            node.firstChild.store(first, std::memory_order_relaxed);
+            node.childCnt.store(static_cast<std::uint16_t>(moveCnt), std::memory_order_relaxed);
+            node.state.store(EXPANDED, std::memory_order_release);
+        }
+
+        // Child of an expanded node with the highest PUCT score, taking virtual losses as lost visits
+        Node &select(const Node &node)
+        {
+            std::uint32_t first = node.firstChild.load(std::memory_order_relaxed);
+            std::size_t cnt = node.childCnt.load(std::memory_order_relaxed);
+            double parentVisits = node.visits.load(std::memory_order_relaxed) +
+                                  static_cast<double>(node.virtualLoss.load(std::memory_order_relaxed));
+            double scale = exploration_ * std::sqrt(parentVisits + 1);
+            Node *best = &nodes_[first];
+            double bestScore = -1;
+            for (std::size_t i = 0; i < cnt; ++i)
+            {
+                Node &child = nodes_[first + i];
+                double visits = child.visits.load(std::memory_order_relaxed) +
+                                static_cast<double>(virtualLossWeight_) *
+                                child.virtualLoss.load(std::memory_order_relaxed);
+                // Unvisited children count as even
+                double q = visits > 0 ? child.halfWins.load(std::memory_order_relaxed) / (2 * visits) : 0.5;
+                double score = q + scale * child.prior / (1 + visits);
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = &child;
+                }
+            }
+            return *best;
+        }
+
+        // b is the root position of this thread, moved along the path with journal and brought back afterwards.
+        // Only a playout, which is not undone, is played on scratch, a copy of the leaf
+        void simulate(BoardType &b, typename BoardType::Journal &journal, BoardType &scratch, PlayoutType &playout,
+                      std::vector<Node *> &path)
+        {
+            Player player = rootPlayer_;
+            std::size_t passes = 0;
+            path.clear();
+            Node *node = &nodes_[0];
+            path.push_back(node);
+            // --- Descend, expanding the first node reached which has been visited but not expanded
+            for (;;)
+            {
+                std::uint8_t state = node->state.load(std::memory_order_acquire);
+                if (state == UNEXPANDED && (node == &nodes_[0] || node->visits.load(std::memory_order_relaxed) > 0) &&
+                        node->state.compare_exchange_strong(state, EXPANDING, std::memory_order_acquire))
+                {
+                    expand(*node, b, player);
+                    state = node->state.load(std::memory_order_relaxed);
+                }
+                // Root has no other branch to turn to, so wait for the thread expanding it
+                while (node == &nodes_[0] && state == EXPANDING)
+                {
+                    std::this_thread::yield();
+                    state = node->state.load(std::memory_order_acquire);
+                }
+                if (state != EXPANDED || passes >= 2)
+                    break;
+                node = &select(*node);
+                node->virtualLoss.fetch_add(1, std::memory_order_relaxed);
+                path.push_back(node);
+                if (node->move == PASS)
+                    ++passes;
+                else
+                {
+                    b.place(node->move, player, journal);
+                    passes = 0;
+                }
+                player = getOpponentPlayer(player);
+            }
+            // --- Evaluate: the game is over after two passes, and scored as it stands, otherwise play it out
+            double score;
+            if (passes >= 2)
+                score = b.getAreaScore(komi_);
+            else
+            {
+                scratch = b;
+                score = playout.play(scratch, player);
+            }
+            while (!journal.empty())
+                b.undo(journal);
+            std::uint32_t blackHalfWins = score > 0 ? 2 : score == 0 ? 1 : 0;
+            // --- Back up. The node at depth d was moved into by rootPlayer_ if d is odd
+            Player mover = getOpponentPlayer(rootPlayer_);
+            for (std::size_t i = 0; i < path.size(); ++i, mover = getOpponentPlayer(mover))
+            {
+                Node &n = *path[i];
+                n.halfWins.fetch_add(mover == Player::B ? blackHalfWins : 2 - blackHalfWins, std::memory_order_relaxed);
+                n.visits.fetch_add(1, std::memory_order_relaxed);
+                if (i > 0)
+                    n.virtualLoss.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        void work(const BoardType &root, std::size_t simulations, std::size_t me)
+        {
+            PlayoutType playout(seed_ + 0x9e3779b97f4a7c15ull * (me + 1), komi_);
+            std::vector<Node *> path;
+            path.reserve(W * H * 2);
+            // Copied once per thread rather than once per simulation
+            BoardType b = root, scratch;
+            b.setChangeTracking(false);
+            typename BoardType::Journal journal;
+            while (started_.fetch_add(1, std::memory_order_relaxed) < simulations)
+                simulate(b, journal, scratch, playout, path);
+        }
+    public:
+        // threads = 0 means one per hardware thread. The tree never grows beyond nodeCapacity nodes;
+        // leaves reached after that are evaluated by playouts without being expanded.
+        explicit MCTS(std::size_t threads = 0, std::size_t nodeCapacity = 1 << 20, double komi = 7.5,
+                      std::uint64_t seed = 0):
+                threadCnt_(threads ? threads : std::max<std::size_t>(std::thread::hardware_concurrency(), 1)),
+                capacity_(std::max<std::size_t>(nodeCapacity, 1)), nodes_(new Node[capacity_]), used_(0),
+                komi_(komi), seed_(seed), prior_(uniformPrior), started_(0)
+        {}
+
+        void setPrior(PriorFunction prior)
+        {
+            prior_ = std::move(prior);
+        }
+        // Weight of the exploration term of PUCT
+        void setExploration(float c)
+        {
+            exploration_ = c;
+        }
+        // How many visits a thread passing through a node counts as, all lost, until its result is backed up
+        void setVirtualLoss(std::uint32_t weight)
+        {
+            virtualLossWeight_ = weight;
+        }
+
+        // Search from root with player to move for simulations playouts, starting with an empty tree.
+        // Returns the most visited move, or PASS.
+        PointType search(const BoardType &root, Player player, std::size_t simulations)
+        {
+            rootPlayer_ = player;
+            used_.store(1);
+            nodes_[0].reset(PASS, 1);
+            started_.store(0);
+            std::vector<std::thread> threads;
+            for (std::size_t i = 1; i < threadCnt_; ++i)
+                threads.emplace_back(&MCTS::work, this, std::cref(root), simulations, i);
+            work(root, simulations, 0);
+            for (std::thread &t: threads)
+                t.join();
+            return getBestMove();
+        }
+
+        PointType getBestMove() const
+        {
+            PointType best = PASS;
+            std::size_t bestVisits = 0;
+            for (const MoveStat &stat: getRootStats())
+                if (stat.visits > bestVisits)
+                {
+                    best = stat.move;
+                    bestVisits = stat.visits;
+                }
+            return best;
+        }
+        // Statistics of children of root after search()
+        std::vector<MoveStat> getRootStats() const
+        {
+            std::vector<MoveStat> stats;
+            const Node &root = nodes_[0];
+            if (root.state.load(std::memory_order_acquire) != EXPANDED)
+                return stats;
+            std::uint32_t first = root.firstChild.load(std::memory_order_relaxed);
+            std::size_t cnt = root.childCnt.load(std::memory_order_relaxed);
+            stats.reserve(cnt);
+            for (std::size_t i = 0; i < cnt; ++i)
+            {
+                const Node &child = nodes_[first + i];
+                std::size_t visits = child.visits.load(std::memory_order_relaxed);
+                stats.push_back(MoveStat {child.move, visits,
+                                          visits ? child.halfWins.load(std::memory_order_relaxed) / (2.0 * visits) : 0,
+                                          child.prior});
+            }
+            return stats;
+        }
+        std::size_t getRootVisits() const
+        {
+            return nodes_[0].visits.load(std::memory_order_relaxed);
+        }
+        // Nodes in the tree, root included
+        std::size_t getNodeCount() const
+        {
+            return std::min(used_.load(std::memory_order_relaxed), capacity_);
+        }
+
+        // Same prior for every move
+        static void uniformPrior(const BoardType &, Player, const PointType *, std::size_t moveCnt, float *priors)
+        {
+            std::fill(priors, priors + moveCnt, 1.0f);
+        }
+        // Prior by Board::getPointScore()
+        static void pointScorePrior(const BoardType &b, Player player, const PointType *moves, std::size_t moveCnt,
+                                    float *priors)
+        {
+            for (std::size_t i = 0; i < moveCnt; ++i)
+                priors[i] = static_cast<float>(b.getPointScore(moves[i], player));
+        }
+        // Prior from a move possibility over the whole board, such as the response of a policy network
+        static PriorFunction possibilityPrior(PossibilityFunction possibility)
+        {
+            return [possibility](const BoardType &b, Player player, const PointType *moves, std::size_t moveCnt,
+                                 float *priors) {
+                std::array<float, W * H> all;
+                possibility(b, player, all.data());
+                for (std::size_t i = 0; i < moveCnt; ++i)
+                    priors[i] = all[moves[i].x * W + moves[i].y];
+            };
+        }
+    };
+
+    template<std::size_t W, std::size_t H>
+    const typename MCTS<W, H>::PointType MCTS<W, H>::PASS(-1, -1);
+}
+#endif //GO_AI_MCTS_HPP
@@ -0,0 +1,65 @@
+#ifndef GO_AI_PADDED_LAYOUT_HPP
+#define GO_AI_PADDED_LAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "basic.hpp"
+#include "grid_point.hpp"
+
+namespace board
+{
+    // Numbering of vertices of a (W + 2) x (H + 2) grid, i.e. Board<W, H> with a one point wide border around it.
+    // Every point on board has all its 8 neighbours as vertices, so a neighbour is found by adding a fixed offset,
+    // and a neighbour off board is told apart by the BORDER state stored there instead of by a boundary check.
+    template<std::size_t W, std::size_t H>
+    struct PaddedLayout
+    {
+        using PointType = GridPoint<W, H>;
+        static const std::size_t STRIDE = W + 2;
+        static const std::size_t SIZE = (W + 2) * (H + 2);
+        // State of a vertex on the border. Never equal to a state of a point on board
+        static constexpr PointState BORDER = static_cast<PointState>(3);
+
+        // Offsets of neighbours, in the same order as GridPoint::for_each_adjacent(): left, up, right, down
+        static constexpr std::ptrdiff_t ADJ[4] = {-1, -static_cast<std::ptrdiff_t>(STRIDE), 1, STRIDE};
+        static constexpr int ADJ_DX[4] = {0, -1, 0, 1};
+        static constexpr int ADJ_DY[4] = {-1, 0, 1, 0};
+        // Same order as GridPoint::for_each_diag(): left up, left down, right up, right down
+        static constexpr std::ptrdiff_t DIAG[4] = {
+                -static_cast<std::ptrdiff_t>(STRIDE) - 1, STRIDE - 1,
+                -static_cast<std::ptrdiff_t>(STRIDE) + 1, STRIDE + 1
+        };
+        static constexpr int DIAG_DX[4] = {-1, 1, -1, 1};
+        static constexpr int DIAG_DY[4] = {-1, -1, 1, 1};
+
+        static std::size_t vertex(PointType p)
+        {
+            return (p.x + 1) * STRIDE + p.y + 1;
+        }
+        // p must be on board, i.e. not on the border
+        static PointType point(std::size_t v)
+        {
+            return PointType(static_cast<char>(v / STRIDE - 1), static_cast<char>(v % STRIDE - 1));
+        }
+        static bool isBorder(std::size_t v)
+        {
+            return v < STRIDE || v >= SIZE - STRIDE || v % STRIDE == 0 || v % STRIDE == STRIDE - 1;
+        }
+    };
+
+    template<std::size_t W, std::size_t H>
+    constexpr PointState PaddedLayout<W, H>::BORDER;
+    template<std::size_t W, std::size_t H>
+    constexpr std::ptrdiff_t PaddedLayout<W, H>::ADJ[4];
+    template<std::size_t W, std::size_t H>
+    constexpr int PaddedLayout<W, H>::ADJ_DX[4];
+    template<std::size_t W, std::size_t H>
+    constexpr int PaddedLayout<W, H>::ADJ_DY[4];
+    template<std::size_t W, std::size_t H>
+    constexpr std::ptrdiff_t PaddedLayout<W, H>::DIAG[4];
+    template<std::size_t W, std::size_t H>
+    constexpr int PaddedLayout<W, H>::DIAG_DX[4];
+    template<std::size_t W, std::size_t H>
+    constexpr int PaddedLayout<W, H>::DIAG_DY[4];
+}
+#endif //GO_AI_PADDED_LAYOUT_HPP
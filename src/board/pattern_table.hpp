@@ -0,0 +1,106 @@
+#ifndef GO_AI_PATTERN_TABLE_HPP
+#define GO_AI_PATTERN_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "basic.hpp"
+
+namespace board
+{
+    // 3x3 pattern around a point, as Board::getPatternCode() keeps it for every point.
+    // Bits 2i and 2i + 1 hold the PointState of the i-th of the 8 neighbours, in the order of
+    // GridPoint::for_each_wrap8(): left, up, right, down, left up, left down, right up, right down,
+    // with PaddedLayout::BORDER (3) for a neighbour off board. Bit ATARI_SHIFT + i is set if the i-th of the
+    // 4 adjacent neighbours is a stone whose group is in atari. The point itself is not part of the code.
+    struct PatternCode
+    {
+        enum: std::uint32_t
+        {
+            NEIGHBOURS = 8,
+            ATARI_SHIFT = 16,
+            BITS = 20,
+            COUNT = 1u << BITS
+        };
+
+        static PointState getState(std::uint32_t code, std::size_t i)
+        {
+            return static_cast<PointState>((code >> (2 * i)) & 3);
+        }
+        static bool isInAtari(std::uint32_t code, std::size_t i)
+        {
+            return (code >> (ATARI_SHIFT + i)) & 1;
+        }
+        // states holds 8 states and inAtari 4 flags, in the order above
+        static std::uint32_t make(const PointState *states, const bool *inAtari)
+        {
+            std::uint32_t code = 0;
+            for (std::size_t i = 0; i < NEIGHBOURS; ++i)
+                code |= static_cast<std::uint32_t>(states[i]) << (2 * i);
+            for (std::size_t i = 0; i < 4; ++i)
+                code |= static_cast<std::uint32_t>(inAtari[i]) << (ATARI_SHIFT + i);
+            return code;
+        }
+        // Same pattern with black and white swapped
+        static std::uint32_t swapColours(std::uint32_t code)
+        {
+            // A field is W or B exactly when its two bits differ, and then both bits flip
+            std::uint32_t differ = (code ^ (code >> 1)) & 0x5555u;
+            return code ^ (differ | (differ << 1));
+        }
+        // Same pattern turned by 90 degrees: left goes up, up goes right, and so on
+        static std::uint32_t rotate(std::uint32_t code)
+        {
+            static const std::size_t to[NEIGHBOURS] = {1, 2, 3, 0, 6, 4, 7, 5};
+            return permute(code, to);
+        }
+        // Same pattern mirrored left to right
+        static std::uint32_t mirror(std::uint32_t code)
+        {
+            static const std::size_t to[NEIGHBOURS] = {2, 1, 0, 3, 6, 7, 4, 5};
+            return permute(code, to);
+        }
+    private:
+        // Move the neighbour in slot i to slot to[i]. Adjacent ones stay among the first 4
+        static std::uint32_t permute(std::uint32_t code, const std::size_t *to)
+        {
+            std::uint32_t result = 0;
+            for (std::size_t i = 0; i < NEIGHBOURS; ++i)
+                result |= ((code >> (2 * i)) & 3) << (2 * to[i]);
+            for (std::size_t i = 0; i < 4; ++i)
+                result |= ((code >> (ATARI_SHIFT + i)) & 1) << (ATARI_SHIFT + to[i]);
+            return result;
+        }
+    };
+
+    // Weight of every pattern code, e.g. for a playout policy which picks moves in proportion to the weight
+    // of their pattern. Weights are stored for black to move; looking up for white swaps colours of the code,
+    // so one table serves both players.
+    class PatternTable
+    {
+        std::vector<float> weights_;
+    public:
+        explicit PatternTable(float defaultWeight = 1.0f):
+                weights_(PatternCode::COUNT, defaultWeight)
+        {}
+
+        // Weight of a move of player at a point with pattern code
+        float get(std::uint32_t code, Player player = Player::B) const
+        {
+            return weights_[player == Player::B ? code : PatternCode::swapColours(code)];
+        }
+        // Set weight of code for black to move
+        void set(std::uint32_t code, float weight)
+        {
+            weights_[code] = weight;
+        }
+        // Set weight of code and of its rotations and reflections
+        void setSymmetric(std::uint32_t code, float weight)
+        {
+            for (std::size_t m = 0; m < 2; ++m, code = PatternCode::mirror(code))
+                for (std::size_t r = 0; r < 4; ++r, code = PatternCode::rotate(code))
+                    weights_[code] = weight;
+        }
+    };
+}
+#endif //GO_AI_PATTERN_TABLE_HPP
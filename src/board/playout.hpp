@@ -0,0 +1,123 @@
+#ifndef GO_AI_PLAYOUT_HPP
+#define GO_AI_PLAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "basic.hpp"
+#include "board_class.hpp"
+
+namespace board
+{
+    // xorshift64* generator. Small and fast enough to keep one per thread
+    class FastRandom
+    {
+        std::uint64_t state_;
+    public:
+        explicit FastRandom(std::uint64_t seed = 0x9e3779b97f4a7c15ull):
+                state_(seed ? seed : 0x9e3779b97f4a7c15ull)
+        {}
+        std::uint64_t operator()()
+        {
+            state_ ^= state_ >> 12;
+            state_ ^= state_ << 25;
+            state_ ^= state_ >> 27;
+            return state_ * 0x2545f4914f6cdd1dull;
+        }
+        // Uniform in [0, n). n must be positive and fit in 32 bits
+        std::size_t below(std::size_t n)
+        {
+            return static_cast<std::size_t>(((*this)() >> 32) * n >> 32);
+        }
+    };
+
+    // Plays a position to the end with uniformly random legal moves, never filling a true eye of the player to move,
+    // and scores it by area. Moves are drawn from Board::getLegalSet(), so a move costs a lookup plus place().
+    // Not thread safe: use one Playout per thread.
+    template<std::size_t W, std::size_t H>
+    class Playout
+    {
+    public:
+        using BoardType = Board<W, H>;
+        using PointType = typename BoardType::PointType;
+        using PointSetType = typename BoardType::PointSetType;
+        using BitboardType = typename BoardType::BitboardType;
+    private:
+        FastRandom rng_;
+        double komi_;
+        std::size_t maxMoves_;
+        std::size_t lastMoves_ = 0;
+
+        // A random move of player in b, or false if there is none but to fill own eyes
+        bool pickMove(const BoardType &b, Player player, PointType &move)
+        {
+            const PointSetType &legal = b.getLegalSet(player);
+            if (legal.count() == 0)
+                return false;
+            // Usually the first pick is fine, so the set is only copied when a pick has to be struck out
+            move = legal.nth(rng_.below(legal.count()));
+            if (isPlayable(b, move, player))
+                return true;
+            PointSetType candidates = legal;
+            for (;;)
+            {
+                candidates.set(move, false);
+                if (candidates.count() == 0)
+                    return false;
+                move = candidates.nth(rng_.below(candidates.count()));
+                if (isPlayable(b, move, player))
+                    return true;
+            }
+        }
+        static bool isPlayable(const BoardType &b, PointType p, Player player)
+        {
+            return !b.isTrueEye(p, player) && (!b.isSuperkoEnabled() || !b.isSuperko(p, player));
+        }
+    public:
+        explicit Playout(std::uint64_t seed = 0, double komi = 7.5, std::size_t maxMoves = W * H * 3):
+                rng_(seed), komi_(komi), maxMoves_(maxMoves)
+        {}
+
+        // Play b to the end, player to move first. The game ends at two passes in a row, or after maxMoves.
+        // Returns area score of black minus that of white minus komi, positive if black wins.
+        // Change tracking of b is off while playing, since nothing reads features of a playout,
+        // and set back as it was before returning.
+        double play(BoardType &b, Player player)
+        {
+            bool tracking = b.isChangeTrackingEnabled();
+            b.setChangeTracking(false);
+            std::size_t passes = 0, moves = 0;
+            for (; passes < 2 && moves < maxMoves_; ++moves, player = getOpponentPlayer(player))
+            {
+                PointType move;
+                if (pickMove(b, player, move))
+                {
+                    b.place(move, player);
+                    passes = 0;
+                }
+                else
+                    ++passes;
+            }
+            lastMoves_ = moves;
+            b.setChangeTracking(tracking);
+            return b.getPlayoutScore(komi_);
+        }
+
+        // Moves (passes included) made by the last play()
+        std::size_t getLastMoveCount() const
+        {
+            return lastMoves_;
+        }
+
+        // Board::getPlayoutArea(), exact on boards played out by play()
+        static BitboardType getArea(const BoardType &b, Player player)
+        {
+            return b.getPlayoutArea(player);
+        }
+        // Size of getArea() of black minus that of white
+        static int getAreaScore(const BoardType &b)
+        {
+            return static_cast<int>(b.getPlayoutScore(0));
+        }
+    };
+}
+#endif //GO_AI_PLAYOUT_HPP
@@ -0,0 +1,203 @@
+#ifndef GO_AI_PLAYOUT_RUNNER_HPP
+#define GO_AI_PLAYOUT_RUNNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "basic.hpp"
+#include "board_class.hpp"
+#include "playout.hpp"
+
+namespace board
+{
+    // Runs many playouts of one position on several threads and aggregates their outcome.
+    // Playouts are split evenly between workers up front. A worker takes a few at a time from the front of
+    // its own range, and when that is empty, steals the back half of the range of another worker,
+    // so long and short playouts even out without any lock.
+    template<std::size_t W, std::size_t H>
+    class PlayoutRunner
+    {
+    public:
+        using BoardType = Board<W, H>;
+        using PlayoutType = Playout<W, H>;
+        using BitboardType = typename BoardType::BitboardType;
+
+        struct Result
+        {
+            std::size_t playouts = 0;
+            std::size_t blackWins = 0;
+            // Mean over playouts of 1 if a point ends up in the area of black, -1 if of white, 0 otherwise.
+            // Indexed by x * W + y
+            std::array<float, W * H> ownership {};
+
+            double getWinRate(Player player) const
+            {
+                if (playouts == 0)
+                    return 0;
+                std::size_t wins = player == Player::B ? blackWins : playouts - blackWins;
+                return static_cast<double>(wins) / playouts;
+            }
+        };
+    private:
+        // Playouts [begin, end) not yet taken from a worker, packed into one word so that the owner taking
+        // from the front and thieves taking from the back agree through a single compare-and-swap.
+        // Slots of different workers are a cache line apart, so that they never share one.
+        struct Slot
+        {
+            std::atomic<std::uint64_t> range;
+        };
+        static const std::size_t SLOT_STRIDE = 64 / sizeof(Slot);
+        struct Tally
+        {
+            std::size_t playouts = 0, blackWins = 0;
+            std::array<int, W * H> ownership {};
+        };
+
+        std::size_t threadCnt_;
+        double komi_;
+        std::uint64_t seed_;
+        std::size_t batch_;
+        std::unique_ptr<Slot[]> storage_;
+        Slot *slots_; // storage_ aligned to 64 bytes, the slot of worker i at slots_[i * SLOT_STRIDE]
+
+        static std::uint64_t pack(std::uint32_t begin, std::uint32_t end)
+        {
+            return (static_cast<std::uint64_t>(begin) << 32) | end;
+        }
+        // Take up to n playouts from the front of slot. Returns how many were taken, starting at begin
+        static std::size_t takeFront(Slot &slot, std::size_t n, std::uint32_t &begin)
+        {
+            std::uint64_t cur = slot.range.load();
+            for (;;)
+            {
+                std::uint32_t b = static_cast<std::uint32_t>(cur >> 32), e = static_cast<std::uint32_t>(cur);
+                if (b >= e)
+                    return 0;
+                std::uint32_t taken = static_cast<std::uint32_t>(std::min<std::size_t>(n, e - b));
+                if (slot.range.compare_exchange_weak(cur, pack(b + taken, e)))
+                {
+                    begin = b;
+                    return taken;
+                }
+            }
+        }
+        // Take the back half (at least one) of the playouts left in slot
+        static bool stealHalf(Slot &slot, std::uint32_t &begin, std::uint32_t &end)
+        {
+            std::uint64_t cur = slot.range.load();
+            for (;;)
+            {
+                std::uint32_t b = static_cast<std::uint32_t>(cur >> 32), e = static_cast<std::uint32_t>(cur);
+                if (b >= e)
+                    return false;
+                std::uint32_t mid = b + (e - b) / 2;
+                if (slot.range.compare_exchange_weak(cur, pack(b, mid)))
+                {
+                    begin = mid;
+                    end = e;
+                    return true;
+                }
+            }
+        }
+        Slot &slot(std::size_t worker)
+        {
+            return slots_[worker * SLOT_STRIDE];
+        }
+        // Refill the empty slot of worker me from another one. False if no work is left anywhere
+        bool steal(std::size_t me)
+        {
+            std::uint32_t begin, end;
+            for (std::size_t i = 1; i < threadCnt_; ++i)
+                if (stealHalf(slot((me + i) % threadCnt_), begin, end))
+                {
+                    slot(me).range.store(pack(begin, end));
+                    return true;
+                }
+            return false;
+        }
+
+        void work(std::size_t me, const BoardType &root, Player player, Tally &tally)
+        {
+            PlayoutType playout(seed_ + 0x9e3779b97f4a7c15ull * (me + 1), komi_);
+            Tally local;
+            BoardType b; // Reset to root by assignment, a memcpy, before each playout
+            for (;;)
+            {
+                std::uint32_t begin;
+                std::size_t n = takeFront(slot(me), batch_, begin);
+                if (n == 0)
+                {
+                    if (steal(me))
+                        continue;
+                    break;
+                }
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    b = root;
+                    local.blackWins += playout.play(b, player) > 0;
+                    PlayoutType::getArea(b, Player::B).forEach([&](typename BoardType::PointType p) {
+                        ++local.ownership[p.x * W + p.y];
+                    });
+                    PlayoutType::getArea(b, Player::W).forEach([&](typename BoardType::PointType p) {
+                        --local.ownership[p.x * W + p.y];
+                    });
+                }
+                local.playouts += n;
+            }
+            tally = local;
+        }
+    public:
+        // threads = 0 means one per hardware thread. batch is how many playouts a worker takes at a time
+        explicit PlayoutRunner(std::size_t threads = 0, double komi = 7.5, std::uint64_t seed = 0,
+                               std::size_t batch = 4):
+                threadCnt_(threads ? threads : std::max<std::size_t>(std::thread::hardware_concurrency(), 1)),
+                komi_(komi), seed_(seed), batch_(batch), storage_(new Slot[(threadCnt_ + 1) * SLOT_STRIDE])
+        {
+            // new only promises alignment of Slot itself, so skip to the first cache line boundary
+            std::size_t misalign = reinterpret_cast<std::uintptr_t>(storage_.get()) % 64 / sizeof(Slot);
+            slots_ = storage_.get() + (SLOT_STRIDE - misalign) % SLOT_STRIDE;
+        }
+
+        std::size_t getThreadCount() const
+        {
+            return threadCnt_;
+        }
+
+        // Run playouts of root with player to move. root itself is not changed; every playout starts from a copy,
+        // made into one board per worker.
+        Result run(const BoardType &root, Player player, std::size_t playouts)
+        {
+            for (std::size_t i = 0; i < threadCnt_; ++i)
+                slot(i).range.store(pack(static_cast<std::uint32_t>(playouts * i / threadCnt_),
+                                           static_cast<std::uint32_t>(playouts * (i + 1) / threadCnt_)));
+            std::vector<Tally> tallies(threadCnt_);
+            std::vector<std::thread> threads;
+            threads.reserve(threadCnt_ - 1);
+            for (std::size_t i = 1; i < threadCnt_; ++i)
+                threads.emplace_back(&PlayoutRunner::work, this, i, std::cref(root), player, std::ref(tallies[i]));
+            work(0, root, player, tallies[0]);
+            for (std::thread &t: threads)
+                t.join();
+
+            Result result;
+            std::array<int, W * H> ownership {};
+            for (const Tally &tally: tallies)
+            {
+                result.playouts += tally.playouts;
+                result.blackWins += tally.blackWins;
+                for (std::size_t i = 0; i < W * H; ++i)
+                    ownership[i] += tally.ownership[i];
+            }
+            if (result.playouts > 0)
+                for (std::size_t i = 0; i < W * H; ++i)
+                    result.ownership[i] = static_cast<float>(ownership[i]) / result.playouts;
+            return result;
+        }
+    };
+}
+#endif //GO_AI_PLAYOUT_RUNNER_HPP
@@ -0,0 +1,98 @@
+#ifndef GO_AI_POINT_SET_HPP
+#define GO_AI_POINT_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <cassert>
+#include "grid_point.hpp"
+
+namespace board
+{
+    // Set of points on Board<W, H>, one bit per point in order of x * W + y, with its size kept up to date.
+    template<std::size_t W, std::size_t H>
+    class PointSet
+    {
+    public:
+        using PointType = GridPoint<W, H>;
+        static const std::size_t WORDS = (W * H + 63) / 64;
+    private:
+        std::array<std::uint64_t, WORDS> words_ {};
+        std::size_t count_ = 0;
+
+        static std::size_t pointToIndex(PointType p)
+        {
+            return p.x * W + p.y;
+        }
+        static PointType indexToPoint(std::size_t idx)
+        {
+            return PointType(static_cast<char>(idx / W), static_cast<char>(idx % W));
+        }
+    public:
+        bool test(PointType p) const
+        {
+            std::size_t idx = pointToIndex(p);
+            return (words_[idx / 64] >> (idx % 64)) & 1;
+        }
+        void set(PointType p, bool value)
+        {
+            std::size_t idx = pointToIndex(p);
+            std::uint64_t mask = std::uint64_t(1) << (idx % 64);
+            std::uint64_t &word = words_[idx / 64];
+            if (((word & mask) != 0) != value)
+            {
+                word ^= mask;
+                if (value)
+                    ++count_;
+                else
+                    --count_;
+            }
+        }
+        void clear()
+        {
+            words_.fill(0);
+            count_ = 0;
+        }
+        // Add points of other
+        PointSet &operator|=(const PointSet &other)
+        {
+            count_ = 0;
+            for (std::size_t i = 0; i < WORDS; ++i)
+            {
+                words_[i] |= other.words_[i];
+                count_ += __builtin_popcountll(words_[i]);
+            }
+            return *this;
+        }
+        // O(1)
+        std::size_t count() const
+        {
+            return count_;
+        }
+        // The n-th point (from 0) in the set, in order of x * W + y. n must be less than count()
+        PointType nth(std::size_t n) const
+        {
+            assert(n < count_);
+            std::size_t i = 0;
+            for (std::size_t cnt; n >= (cnt = __builtin_popcountll(words_[i])); ++i)
+                n -= cnt;
+            std::uint64_t word = words_[i];
+            for (; n > 0; --n)
+                word &= word - 1; // drop the lowest bit
+            return indexToPoint(i * 64 + __builtin_ctzll(word));
+        }
+        // Call f(PointType) on every point in the set, in order of x * W + y
+        template<typename FT>
+        void forEach(FT f) const
+        {
+            for (std::size_t i = 0; i < WORDS; ++i)
+                for (std::uint64_t word = words_[i]; word != 0; word &= word - 1)
+                    f(indexToPoint(i * 64 + __builtin_ctzll(word)));
+        }
+        const std::array<std::uint64_t, WORDS> &words() const
+        {
+            return words_;
+        }
+    };
+}
+#endif //GO_AI_POINT_SET_HPP
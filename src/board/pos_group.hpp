@@ -7,123 +7,138 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <list>
 #include <algorithm>
 #include <iterator>
-#include <functional>
 #include <array>
 #include <vector>
+#include "basic.hpp"
 #include "grid_point.hpp"
-#include "group_node.hpp"
-#include "logger.hpp"
 
 namespace board
 {
     template <std::uint_least8_t W, std::uint_least8_t H>
     class PosGroup
     {
-        using GroupIterator = typename std::list< GroupNode<W, H> >::iterator;
-        using GroupConstIterator = typename std::list< GroupNode<W, H> >::const_iterator;
-        std::shared_ptr<spdlog::logger> logger = getGlobalLogger();
     public:
         using PointType = GridPoint<W, H>;
 
-        struct GroupConstIteratorHash
-        {
-            std::hash<const GroupNode<W, H>*> h;
-            std::size_t operator() (GroupConstIterator gci) const
-            {
-                return h(&(*gci));
-            }
-        };
-
         struct ItemType
         {
             union Value
             {
-                GroupIterator groupIterator;
+                GroupId groupId;
                 PointType pointType;
 
-                Value(GroupIterator gi): groupIterator(gi) {}
+                Value(GroupId gi): groupId(gi) {}
                 Value(PointType p): pointType(p) {}
                 Value() {}
             } value;
-            enum struct Type {GroupIterator, PointType} type;
+            enum struct Type: std::uint8_t {GroupId, PointType} type;
+            std::uint8_t rank; // Upper bound of tree height, meaningful for roots only
             ItemType()
             {
             }
         };
+        // Records overwritten entries, so that a sequence of set()/merge() can be reverted
+        using ChangeLog = std::vector< std::pair<std::size_t, ItemType> >;
     protected:
-        mutable std::array<ItemType, W * H> arr;
+        std::array<ItemType, W * H> arr;
 
         static std::size_t pointToIndex(PointType p)
         {
             return p.x * W + p.y;
         }
 
+        // Read-only lookup. Never compresses the path, so const queries leave arr untouched
+        // and may run concurrently. Union by rank keeps the path within log2(W * H) steps.
         PointType findfa(PointType p) const
         {
-            std::size_t idx = pointToIndex(p);
-            if (arr[idx].type == ItemType::Type::GroupIterator)
-            {
-                return p;
-            }
-            else
-            {
-                arr[idx].value.pointType = findfa(arr[idx].value.pointType);
-                return arr[idx].value.pointType;
-            }
+            while (arr[pointToIndex(p)].type == ItemType::Type::PointType)
+                p = arr[pointToIndex(p)].value.pointType;
+            return p;
         }
 
-    public:
-        PosGroup() = default;
-        PosGroup(const PosGroup& other,
-                 const std::vector<std::pair<GroupConstIterator , GroupIterator>> &oldToNewMap):
-                arr(other.arr), logger(other.logger)
+        // Lookup with path compression. Every write goes to log if it is not null
+        PointType findfaCompress(PointType p, ChangeLog *log)
         {
-            PointType::for_all([&](PointType p) {
-                if (arr[pointToIndex(p)].type == ItemType::Type::GroupIterator)
+            PointType fa = findfa(p);
+            while (p != fa)
+            {
+                std::size_t idx = pointToIndex(p);
+                PointType next = arr[idx].value.pointType;
+                if (next != fa)
                 {
-                    using PairT = std::pair<GroupConstIterator, GroupConstIterator>;
-                    auto it = std::find_if(oldToNewMap.cbegin(), oldToNewMap.cend(), [&](const PairT &pair) {
-                        return pair.first == arr[pointToIndex(p)].value.groupIterator;
-                    });
-                    arr[pointToIndex(p)].value.groupIterator = it->second;
+                    record(idx, log);
+                    arr[idx].value.pointType = fa;
                 }
-            });
+                p = next;
+            }
+            return fa;
         }
-        PosGroup(GroupIterator default_it)
+
+        void record(std::size_t idx, ChangeLog *log) const
         {
-            fill(default_it);
+            if (log)
+                log->push_back(std::make_pair(idx, arr[idx]));
         }
-        void fill(GroupIterator default_it)
+
+    public:
+        PosGroup() = default;
+        PosGroup(GroupId default_id)
+        {
+            fill(default_id);
+        }
+        void fill(GroupId default_id)
         {
             std::for_each(std::begin(arr), std::end(arr), [&](ItemType &item) {
-                item.type = ItemType::Type::GroupIterator;
-                item.value.groupIterator = default_it;
+                item.type = ItemType::Type::GroupId;
+                item.value.groupId = default_id;
+                item.rank = 0;
             });
         }
-        GroupIterator get(PointType p) const
+        GroupId get(PointType p) const
         {
             PointType fa = findfa(p);
-            return arr[pointToIndex(fa)].value.groupIterator;
+            return arr[pointToIndex(fa)].value.groupId;
         }
-        // Use this only if this is the first time set(*, this_iterator) is called! otherwise please use merge()!
-        void set(PointType p, GroupIterator it)
+        // Use this only if this is the first time set(*, this_id) is called! otherwise please use merge()!
+        void set(PointType p, GroupId id, ChangeLog *log = nullptr)
         {
-            arr[pointToIndex(p)].type = ItemType::Type::GroupIterator;
-            arr[pointToIndex(p)].value.groupIterator = it;
+            record(pointToIndex(p), log);
+            arr[pointToIndex(p)].type = ItemType::Type::GroupId;
+            arr[pointToIndex(p)].value.groupId = id;
+            arr[pointToIndex(p)].rank = 0;
         }
 
-        // Merge p2 into p1
-        // fa[ getfa(p2) ] = getfa(p1)
-        void merge(PointType p1, PointType p2)
+        // Merge p2 into p1: afterwards both get() the id p1 had.
+        // The lower ranked root is linked under the other one, whichever side it is on.
+        void merge(PointType p1, PointType p2, ChangeLog *log = nullptr)
         {
-            PointType fa1 = findfa(p1), fa2 = findfa(p2);
-            if (fa1 != fa2) {
-                arr[pointToIndex(fa2)].type = ItemType::Type::PointType;
-                arr[pointToIndex(fa2)].value.pointType = p1;
+            PointType fa1 = findfaCompress(p1, log), fa2 = findfaCompress(p2, log);
+            if (fa1 == fa2)
+                return;
+            std::size_t idx1 = pointToIndex(fa1), idx2 = pointToIndex(fa2);
+            GroupId id = arr[idx1].value.groupId;
+            if (arr[idx1].rank < arr[idx2].rank)
+            {
+                std::swap(fa1, fa2);
+                std::swap(idx1, idx2);
             }
+            record(idx1, log);
+            record(idx2, log);
+            arr[idx2].type = ItemType::Type::PointType;
+            arr[idx2].value.pointType = fa1;
+            arr[idx1].value.groupId = id;
+            if (arr[idx1].rank == arr[idx2].rank)
+                ++arr[idx1].rank;
+        }
+
+        // Undo every change recorded in log, latest first
+        void revert(const ChangeLog &log)
+        {
+            std::for_each(log.rbegin(), log.rend(), [&](const std::pair<std::size_t, ItemType> &item) {
+                arr[item.first] = item.second;
+            });
         }
 
     };
@@ -0,0 +1,314 @@
+#ifndef GO_AI_TACTICAL_READER_HPP
+#define GO_AI_TACTICAL_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include "basic.hpp"
+#include "board_class.hpp"
+
+namespace board
+{
+    // Reads whether a group can be captured, by a search which only looks at moves around it: the attacker plays
+    // on its liberties, the defender extends on its liberties or captures attacking groups in atari next to it.
+    // Moves are made and taken back on one scratch board with a Journal. Search stops after a budget of nodes,
+    // and results are cached by situation hash, so positions reached by different orders are read once.
+    // Not thread safe: use one TacticalReader per thread.
+    template<std::size_t W, std::size_t H>
+    class TacticalReader
+    {
+    public:
+        using BoardType = Board<W, H>;
+        using PointType = typename BoardType::PointType;
+
+        enum struct Outcome: std::uint8_t
+        {
+            UNKNOWN, // Ran out of node budget
+            ALIVE, // The group gets more liberties than the search looks at, whoever moves first
+            DEAD // The group is captured however the defender answers
+        };
+    private:
+        struct CacheEntry
+        {
+            std::uint64_t key = 0;
+            PointType move = PointType(-1, -1);
+            Outcome outcome = Outcome::UNKNOWN; // UNKNOWN marks an empty entry
+        };
+        using MoveArray = std::array<PointType, W * H>;
+
+        std::size_t nodeBudget_;
+        std::size_t nodes_ = 0;
+        std::vector<CacheEntry> cache_;
+        BoardType board_;
+        typename BoardType::Journal journal_;
+
+        std::uint64_t cacheKey(PointType target, std::size_t maxLiberty, Player toMove) const
+        {
+            return board_.getSituationHash(toMove) ^
+                   (static_cast<std::uint64_t>(target.x * W + target.y + 1) * 0x9e3779b97f4a7c15ull) ^
+                   (static_cast<std::uint64_t>(maxLiberty) << 56);
+        }
+        CacheEntry &cacheEntry(std::uint64_t key)
+        {
+            return cache_[static_cast<std::size_t>(key) & (cache_.size() - 1)];
+        }
+        // Look up a definite result, storing it into move
+        bool probe(std::uint64_t key, Outcome &outcome, PointType &move)
+        {
+            const CacheEntry &entry = cacheEntry(key);
+            if (entry.outcome == Outcome::UNKNOWN || entry.key != key)
+                return false;
+            outcome = entry.outcome;
+            move = entry.move;
+            return true;
+        }
+        Outcome store(std::uint64_t key, Outcome outcome, PointType move)
+        {
+            if (outcome != Outcome::UNKNOWN)
+            {
+                CacheEntry &entry = cacheEntry(key);
+                entry.key = key;
+                entry.move = move;
+                entry.outcome = outcome;
+            }
+            return outcome;
+        }
+
+        static void addMove(MoveArray &moves, std::size_t &moveCnt, PointType p)
+        {
+            if (std::find(moves.begin(), moves.begin() + moveCnt, p) == moves.begin() + moveCnt)
+                moves[moveCnt++] = p;
+        }
+        // Add the liberty liberties of the group at target to moves
+        void addLiberties(PointType target, std::size_t liberty, MoveArray &moves, std::size_t &moveCnt) const
+        {
+            if (liberty <= 2)
+            {
+                for (PointType p: board_.getLowLiberties(board_.getPointGroup(target)))
+                    if (p != PointType(-1, -1))
+                        addMove(moves, moveCnt, p);
+            }
+            else
+                board_.getGroupLibertySet(target).forEach([&](PointType p) {
+                    addMove(moves, moveCnt, p);
+                });
+        }
+        bool isLegal(PointType p, Player player) const
+        {
+            return board_.getLegalSet(player).test(p) && (!board_.isSuperkoEnabled() || !board_.isSuperko(p, player));
+        }
+
+        // Attacker to move against the group at target. DEAD if some move captures it, move being that one
+        Outcome attack(PointType target, std::size_t maxLiberty, PointType &move)
+        {
+            move = PointType(-1, -1);
+            if (++nodes_ > nodeBudget_)
+                return Outcome::UNKNOWN;
+            typename BoardType::GroupConstIterator group = board_.getPointGroup(target);
+            std::size_t liberty = group->getLiberty();
+            if (liberty > maxLiberty)
+                return Outcome::ALIVE;
+            Player attacker = getOpponentPlayer(group->getPlayer());
+            std::uint64_t key = cacheKey(target, maxLiberty, attacker);
+            Outcome outcome;
+            if (probe(key, outcome, move))
+                return outcome;
+
+            MoveArray moves;
+            std::size_t moveCnt = 0;
+            addLiberties(target, liberty, moves, moveCnt);
+            bool unknown = false;
+            for (std::size_t i = 0; i < moveCnt; ++i)
+            {
+                if (!isLegal(moves[i], attacker))
+                    continue;
+                board_.place(moves[i], attacker, journal_);
+                PointType reply;
+                outcome = board_.getPointState(target) == PointState::NA ? Outcome::DEAD :
+                          defend(target, maxLiberty, reply);
+                board_.undo(journal_);
+                if (outcome == Outcome::DEAD)
+                {
+                    move = moves[i];
+                    return store(key, Outcome::DEAD, move);
+                }
+                unknown = unknown || outcome == Outcome::UNKNOWN;
+            }
+            return store(key, unknown ? Outcome::UNKNOWN : Outcome::ALIVE, move);
+        }
+        // Defender of the group at target to move. ALIVE if some move saves it, move being that one,
+        // or (-1, -1) if it needs no move
+        Outcome defend(PointType target, std::size_t maxLiberty, PointType &move)
+        {
+            move = PointType(-1, -1);
+            if (++nodes_ > nodeBudget_)
+                return Outcome::UNKNOWN;
+            typename BoardType::GroupConstIterator group = board_.getPointGroup(target);
+            std::size_t liberty = group->getLiberty();
+            if (liberty > maxLiberty)
+                return Outcome::ALIVE;
+            Player defender = group->getPlayer(), attacker = getOpponentPlayer(defender);
+            std::uint64_t key = cacheKey(target, maxLiberty, defender);
+            Outcome outcome;
+            if (probe(key, outcome, move))
+                return outcome;
+
+            // Capture an attacking group in atari next to ours first, then extend
+            MoveArray moves;
+            std::size_t moveCnt = 0;
+            PointState attackerState = getPointStateFromPlayer(attacker);
+            board_.forEachStone(group, [&](PointType stone) {
+                stone.for_each_adjacent([&](PointType adjP) {
+                    if (board_.getPointState(adjP) == attackerState)
+                    {
+                        PointType capture = board_.getAtariLiberty(board_.getPointGroup(adjP));
+                        if (capture != PointType(-1, -1))
+                            addMove(moves, moveCnt, capture);
+                    }
+                });
+            });
+            addLiberties(target, liberty, moves, moveCnt);
+            bool unknown = false;
+            for (std::size_t i = 0; i < moveCnt; ++i)
+            {
+                if (!isLegal(moves[i], defender))
+                    continue;
+                board_.place(moves[i], defender, journal_);
+                PointType reply;
+                outcome = attack(target, maxLiberty, reply);
+                board_.undo(journal_);
+                if (outcome == Outcome::ALIVE)
+                {
+                    move = moves[i];
+                    return store(key, Outcome::ALIVE, move);
+                }
+                unknown = unknown || outcome == Outcome::UNKNOWN;
+            }
+            // With more than one liberty, the defender may as well play elsewhere
+            if (liberty > 1)
+            {
+                PointType reply;
+                outcome = attack(target, maxLiberty, reply);
+                if (outcome == Outcome::ALIVE)
+                    return store(key, Outcome::ALIVE, move);
+                unknown = unknown || outcome == Outcome::UNKNOWN;
+            }
+            return store(key, unknown ? Outcome::UNKNOWN : Outcome::DEAD, move);
+        }
+
+        // Copy b to the scratch board
+        void load(const BoardType &b)
+        {
+            board_ = b;
+            board_.setChangeTracking(false);
+            journal_.clear();
+        }
+        // Read the group at target, which must be a stone, on the scratch board as it is
+        Outcome readLoaded(PointType target, Player toMove, std::size_t maxLiberty, PointType &move)
+        {
+            nodes_ = 0;
+            return board_.getPointGroup(target)->getPlayer() == toMove ? defend(target, maxLiberty, move) :
+                   attack(target, maxLiberty, move);
+        }
+        Outcome read(const BoardType &b, PointType target, Player toMove, std::size_t maxLiberty, PointType &move)
+        {
+            if (b.getPointState(target) == PointState::NA)
+                throw std::runtime_error("Try to read an empty point");
+            load(b);
+            return readLoaded(target, toMove, maxLiberty, move);
+        }
+        // Whether, after player plays at p, some group next to p of state adjState, for which pred holds in b,
+        // is still there and reads as outcome in a ladder with the opponent of player to move.
+        // b is copied once, and p is played and taken back on the scratch board.
+        template<typename Pred>
+        bool ladderAfterMove(const BoardType &b, PointType p, Player player, PointState adjState, Pred pred,
+                             Outcome outcome)
+        {
+            if (!b.getLegalSet(player).test(p))
+                return false;
+            bool any = false;
+            p.for_each_adjacent([&](PointType adjP) {
+                any = any || (b.getPointState(adjP) == adjState && pred(b.getPointGroup(adjP)));
+            });
+            if (!any)
+                return false;
+            load(b);
+            board_.place(p, player, journal_);
+            bool found = false;
+            p.for_each_adjacent([&](PointType adjP) {
+                if (found || b.getPointState(adjP) != adjState || !pred(b.getPointGroup(adjP)) ||
+                    board_.getPointState(adjP) != adjState)
+                    return;
+                PointType move;
+                found = readLoaded(adjP, getOpponentPlayer(player), 2, move) == outcome;
+            });
+            board_.undo(journal_);
+            return found;
+        }
+    public:
+        // Searches stop after nodeBudget nodes. cacheSize is rounded up to a power of 2
+        explicit TacticalReader(std::size_t nodeBudget = 1000, std::size_t cacheSize = 1 << 12):
+                nodeBudget_(nodeBudget), cache_(nextPowerOf2(std::max<std::size_t>(cacheSize, 1)))
+        {}
+
+        void setNodeBudget(std::size_t nodeBudget)
+        {
+            nodeBudget_ = nodeBudget;
+        }
+        // Nodes searched by the last read
+        std::size_t getNodeCount() const
+        {
+            return nodes_;
+        }
+        // Forget cached results
+        void clearCache()
+        {
+            std::fill(cache_.begin(), cache_.end(), CacheEntry());
+        }
+
+        // Whether the group at target, which must be a stone, can be captured with toMove to move, reading until
+        // it has more than maxLiberty liberties. move is set to the capturing move if the attacker is to move
+        // and it is DEAD, or to the saving move if the defender is to move and it is ALIVE. (-1, -1) otherwise.
+        Outcome readCapture(const BoardType &b, PointType target, Player toMove, PointType &move,
+                            std::size_t maxLiberty = 3)
+        {
+            return read(b, target, toMove, maxLiberty, move);
+        }
+        Outcome readCapture(const BoardType &b, PointType target, Player toMove, std::size_t maxLiberty = 3)
+        {
+            PointType move;
+            return read(b, target, toMove, maxLiberty, move);
+        }
+        // Ladder reading: the attacker keeps the group in atari, and it escapes once it has 3 liberties
+        Outcome readLadder(const BoardType &b, PointType target, Player toMove, PointType &move)
+        {
+            return read(b, target, toMove, 2, move);
+        }
+        Outcome readLadder(const BoardType &b, PointType target, Player toMove)
+        {
+            PointType move;
+            return read(b, target, toMove, 2, move);
+        }
+
+        // Whether player at empty point p puts a group next to it with 2 liberties into a ladder that works
+        bool isLadderCapture(const BoardType &b, PointType p, Player player)
+        {
+            return ladderAfterMove(b, p, player, getPointStateFromPlayer(getOpponentPlayer(player)),
+                                   [](typename BoardType::GroupConstIterator group) {
+                                       return group->getLiberty() == 2;
+                                   }, Outcome::DEAD);
+        }
+        // Whether player at empty point p gets a group of its own next to it out of atari and out of the ladder
+        bool isLadderEscape(const BoardType &b, PointType p, Player player)
+        {
+            return ladderAfterMove(b, p, player, getPointStateFromPlayer(player),
+                                   [](typename BoardType::GroupConstIterator group) {
+                                       return group->isInAtari();
+                                   }, Outcome::ALIVE);
+        }
+    };
+}
+#endif //GO_AI_TACTICAL_READER_HPP
@@ -0,0 +1,232 @@
+#ifndef GO_AI_TRANSPOSITION_TABLE_HPP
+#define GO_AI_TRANSPOSITION_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include "basic.hpp"
+#include "board_class.hpp"
+#include "hash_history.hpp"
+
+namespace board
+{
+    // Fixed size table of search results keyed by Board::getSituationHash(), shared by any number of threads
+    // without locks. Entries are grouped 4 to a 64-byte bucket, so a probe touches one cache line.
+    // An entry is a data word and its key xor'ed with the data word, each stored atomically. A reader whose key
+    // doesn't give back the data word has seen a torn or foreign entry and treats it as a miss, so racing writers
+    // can lose an entry but never make a reader see a wrong one.
+    template<std::size_t W, std::size_t H>
+    class TranspositionTable
+    {
+        static_assert(W * H < 511, "Moves of TranspositionTable are stored in 9 bits");
+    public:
+        using BoardType = Board<W, H>;
+        using PointType = typename BoardType::PointType;
+
+        struct Entry
+        {
+            std::uint32_t visits = 0; // Saturates at MAX_VISITS. Entries with no visit are not stored
+            float winRate = 0; // For the player to move. Kept to 1/65535
+            PointType bestMove = PointType(-1, -1); // (-1, -1) for a pass or no move
+        };
+
+        // Which entry of a full bucket a new position evicts
+        enum struct ReplacePolicy
+        {
+            ALWAYS, // An entry picked by the key, whatever it holds
+            VISITS, // The entry with fewest visits, if the new one has at least as many
+            AGED_VISITS // As VISITS, but entries stored before the last newSearch() go first, regardless of visits
+        };
+
+        static const std::size_t BUCKET_ENTRIES = 4;
+        static const std::uint32_t MAX_VISITS = (1u << 24) - 1;
+    private:
+        // Bits of the data word
+        static const unsigned VALUE_SHIFT = 24, MOVE_SHIFT = 40, GENERATION_SHIFT = 56;
+        static const std::uint64_t NO_MOVE = 511;
+
+        struct Slot
+        {
+            std::atomic<std::uint64_t> check; // key ^ data
+            std::atomic<std::uint64_t> data; // 0 marks an empty slot
+        };
+        static_assert(sizeof(Slot) * BUCKET_ENTRIES == 64, "A bucket of TranspositionTable must fill a cache line");
+
+        std::size_t bucketCnt_;
+        ReplacePolicy policy_;
+        std::unique_ptr<Slot[]> storage_;
+        Slot *slots_; // storage_ aligned to 64 bytes, BUCKET_ENTRIES * bucketCnt_ of them
+        std::atomic<std::uint32_t> generation_;
+
+        Slot *bucket(std::uint64_t key) const
+        {
+            return slots_ + (static_cast<std::size_t>(key) & (bucketCnt_ - 1)) * BUCKET_ENTRIES;
+        }
+        static std::uint32_t getVisits(std::uint64_t data)
+        {
+            return static_cast<std::uint32_t>(data & MAX_VISITS);
+        }
+        static std::uint32_t getGeneration(std::uint64_t data)
+        {
+            return static_cast<std::uint32_t>(data >> GENERATION_SHIFT);
+        }
+        std::uint64_t pack(const Entry &entry) const
+        {
+            float winRate = std::min(std::max(entry.winRate, 0.0f), 1.0f);
+            std::uint64_t value = static_cast<std::uint64_t>(winRate * 65535.0f + 0.5f);
+            std::uint64_t move = entry.bestMove == PointType(-1, -1) ? NO_MOVE :
+                                 static_cast<std::uint64_t>(entry.bestMove.x * W + entry.bestMove.y);
+            return std::min(entry.visits, MAX_VISITS) | value << VALUE_SHIFT | move << MOVE_SHIFT |
+                   static_cast<std::uint64_t>(generation_.load(std::memory_order_relaxed) & 0xff) << GENERATION_SHIFT;
+        }
+        static Entry unpack(std::uint64_t data)
+        {
+            Entry entry;
+            entry.visits = getVisits(data);
+            entry.winRate = static_cast<float>((data >> VALUE_SHIFT) & 0xffff) / 65535.0f;
+            std::size_t move = static_cast<std::size_t>((data >> MOVE_SHIFT) & NO_MOVE);
+            if (move != NO_MOVE)
+                entry.bestMove = PointType(static_cast<char>(move / W), static_cast<char>(move % W));
+            return entry;
+        }
+        static std::uint64_t readData(const Slot &slot, std::uint64_t &key)
+        {
+            std::uint64_t check = slot.check.load(std::memory_order_relaxed),
+                    data = slot.data.load(std::memory_order_relaxed);
+            key = check ^ data;
+            return data;
+        }
+        // The slot of bucket a new entry should go to, or nullptr if it should be dropped
+        Slot *pickVictim(Slot *b, std::uint64_t key, std::uint32_t visits) const
+        {
+            if (policy_ == ReplacePolicy::ALWAYS)
+                return b + ((key * 0x9e3779b97f4a7c15ull) >> 62) % BUCKET_ENTRIES;
+            std::uint32_t generation = generation_.load(std::memory_order_relaxed) & 0xff;
+            Slot *victim = nullptr;
+            std::uint32_t victimVisits = 0;
+            for (std::size_t i = 0; i < BUCKET_ENTRIES; ++i)
+            {
+                std::uint64_t slotKey, data = readData(b[i], slotKey);
+                if (policy_ == ReplacePolicy::AGED_VISITS && getGeneration(data) != generation)
+                    return b + i;
+                if (!victim || getVisits(data) < victimVisits)
+                {
+                    victim = b + i;
+                    victimVisits = getVisits(data);
+                }
+            }
+            return visits >= victimVisits ? victim : nullptr;
+        }
+    public:
+        // bucketCount is rounded up to a power of 2. Takes 64 bytes per bucket
+        explicit TranspositionTable(std::size_t bucketCount = 1 << 16,
+                                    ReplacePolicy policy = ReplacePolicy::AGED_VISITS):
+                bucketCnt_(nextPowerOf2(std::max<std::size_t>(bucketCount, 1))), policy_(policy),
+                storage_(new Slot[(bucketCnt_ + 1) * BUCKET_ENTRIES]), generation_(0)
+        {
+            // new only promises alignment of Slot itself, so skip to the first cache line boundary
+            std::size_t misalign = reinterpret_cast<std::uintptr_t>(storage_.get()) % 64 / sizeof(Slot);
+            slots_ = storage_.get() + (BUCKET_ENTRIES - misalign) % BUCKET_ENTRIES;
+            clear();
+        }
+
+        ReplacePolicy getReplacePolicy() const
+        {
+            return policy_;
+        }
+        void setReplacePolicy(ReplacePolicy policy)
+        {
+            policy_ = policy;
+        }
+        std::size_t getBucketCount() const
+        {
+            return bucketCnt_;
+        }
+        std::size_t getCapacity() const
+        {
+            return bucketCnt_ * BUCKET_ENTRIES;
+        }
+
+        // Empty the table. Not safe while other threads use it
+        void clear()
+        {
+            for (std::size_t i = 0; i < getCapacity(); ++i)
+            {
+                slots_[i].check.store(0, std::memory_order_relaxed);
+                slots_[i].data.store(0, std::memory_order_relaxed);
+            }
+            generation_.store(0, std::memory_order_relaxed);
+        }
+        // Mark entries stored so far as old, for ReplacePolicy::AGED_VISITS. Call before each search
+        void newSearch()
+        {
+            generation_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Look key up. Returns false and leaves entry unchanged on a miss
+        bool probe(std::uint64_t key, Entry &entry) const
+        {
+            Slot *b = bucket(key);
+            for (std::size_t i = 0; i < BUCKET_ENTRIES; ++i)
+            {
+                std::uint64_t slotKey, data = readData(b[i], slotKey);
+                if (data != 0 && slotKey == key)
+                {
+                    entry = unpack(data);
+                    return true;
+                }
+            }
+            return false;
+        }
+        // Store entry under key, replacing any entry of key, otherwise an empty one or one chosen by the policy.
+        // Entries with no visit are ignored.
+        void store(std::uint64_t key, const Entry &entry)
+        {
+            if (entry.visits == 0)
+                return;
+            Slot *b = bucket(key), *target = nullptr, *empty = nullptr;
+            for (std::size_t i = 0; i < BUCKET_ENTRIES && !target; ++i)
+            {
+                std::uint64_t slotKey, data = readData(b[i], slotKey);
+                if (data != 0 && slotKey == key)
+                    target = b + i;
+                else if (data == 0 && !empty)
+                    empty = b + i;
+            }
+            if (!target)
+                target = empty;
+            if (!target && !(target = pickVictim(b, key, entry.visits)))
+                return;
+            std::uint64_t data = pack(entry);
+            target->data.store(data, std::memory_order_relaxed);
+            target->check.store(key ^ data, std::memory_order_relaxed);
+        }
+
+        // The same keyed by the situation of b with player to move
+        bool probe(const BoardType &b, Player player, Entry &entry) const
+        {
+            return probe(b.getSituationHash(player), entry);
+        }
+        void store(const BoardType &b, Player player, const Entry &entry)
+        {
+            store(b.getSituationHash(player), entry);
+        }
+
+        // Entries in use. Walks the whole table
+        std::size_t countUsed() const
+        {
+            std::size_t cnt = 0;
+            for (std::size_t i = 0; i < getCapacity(); ++i)
+                cnt += slots_[i].data.load(std::memory_order_relaxed) != 0;
+            return cnt;
+        }
+    };
+
+    template<std::size_t W, std::size_t H>
+    const std::size_t TranspositionTable<W, H>::BUCKET_ENTRIES;
+    template<std::size_t W, std::size_t H>
+    const std::uint32_t TranspositionTable<W, H>::MAX_VISITS;
+}
+#endif //GO_AI_TRANSPOSITION_TABLE_HPP
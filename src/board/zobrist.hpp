@@ -0,0 +1,58 @@
+#ifndef GO_AI_ZOBRIST_HPP
+#define GO_AI_ZOBRIST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "basic.hpp"
+#include "grid_point.hpp"
+
+namespace board
+{
+    // Zobrist keys of Board<W, H>.
+    // Each key is splitmix64 of its index, so no table needs initializing.
+    template<std::size_t W, std::size_t H>
+    struct Zobrist
+    {
+        using PointType = GridPoint<W, H>;
+    private:
+        static const std::uint64_t SEED = 0x5bd1e9955bd1e995ull;
+
+        static constexpr std::uint64_t mix1(std::uint64_t z)
+        {
+            return (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        }
+        static constexpr std::uint64_t mix2(std::uint64_t z)
+        {
+            return (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        }
+        static constexpr std::uint64_t mix3(std::uint64_t z)
+        {
+            return z ^ (z >> 31);
+        }
+        static constexpr std::uint64_t key(std::size_t idx)
+        {
+            return mix3(mix2(mix1(SEED + (idx + 1) * 0x9e3779b97f4a7c15ull)));
+        }
+        static std::size_t pointToIndex(PointType p)
+        {
+            return p.x * W + p.y;
+        }
+    public:
+        // Key of a stone with state s at p. 0 for an empty point
+        static std::uint64_t stoneKey(PointType p, PointState s)
+        {
+            return s == PointState::NA ? 0 : key(pointToIndex(p) * 2 + (s == PointState::B ? 1 : 0));
+        }
+        // Key of a simple ko point at p
+        static std::uint64_t koKey(PointType p)
+        {
+            return key(2 * W * H + pointToIndex(p));
+        }
+        // Key of side to move. 0 for white
+        static std::uint64_t playerKey(Player p)
+        {
+            return p == Player::B ? key(3 * W * H) : 0;
+        }
+    };
+}
+#endif //GO_AI_ZOBRIST_HPP
@@ -0,0 +1,271 @@
+// Benchmarks of the hot paths of Board, for every size board.cpp instantiates.
+// Positions come from random games of a fixed seed, so runs are comparable across builds.
+// Run with --benchmark_format=json, or --benchmark_out=<file> --benchmark_out_format=json, for JSON output.
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "board.hpp"
+
+namespace
+{
+    using board::Board;
+    using board::Player;
+
+    const std::uint32_t SEED = 20161017;
+    const std::size_t POSITION_CNT = 16;
+
+    // Moves of a random game from an empty board, alternating players and picking uniformly among
+    // getAllGoodPosition(). Stops after maxMoves moves, or when the player to move has no good move.
+    template<std::size_t W, std::size_t H>
+    std::vector<typename Board<W, H>::PointType> randomGame(std::mt19937 &rng, std::size_t maxMoves)
+    {
+        std::vector<typename Board<W, H>::PointType> moves;
+        Board<W, H> b;
+        Player player = Player::B;
+        for (std::size_t i = 0; i < maxMoves; ++i, player = board::getOpponentPlayer(player))
+        {
+            auto good = b.getAllGoodPosition(player);
+            if (good.empty())
+                break;
+            auto p = good[rng() % good.size()];
+            b.place(p, player);
+            moves.push_back(p);
+        }
+        return moves;
+    }
+
+    // POSITION_CNT positions filled to about a third of the board, the same on every run
+    template<std::size_t W, std::size_t H>
+    const std::vector<Board<W, H>> &getPositions()
+    {
+        static const std::vector<Board<W, H>> positions = [] {
+            std::mt19937 rng(SEED + W * H);
+            std::vector<Board<W, H>> result(POSITION_CNT);
+            for (Board<W, H> &b: result)
+            {
+                Player player = Player::B;
+                for (auto p: randomGame<W, H>(rng, W * H / 3))
+                {
+                    b.place(p, player);
+                    player = board::getOpponentPlayer(player);
+                }
+            }
+            return result;
+        }();
+        return positions;
+    }
+
+    // Player the i-th iteration asks about, black and white in turn
+    Player getPlayer(std::size_t i)
+    {
+        return i % 2 ? Player::W : Player::B;
+    }
+
+    template<std::size_t N>
+    void BM_Place(benchmark::State &state)
+    {
+        using BT = Board<N, N>;
+        std::mt19937 rng(SEED + N * N);
+        auto moves = randomGame<N, N>(rng, N * N);
+        BT b;
+        std::size_t placed = 0;
+        for (auto _: state)
+        {
+            b.clear();
+            Player player = Player::B;
+            for (auto p: moves)
+            {
+                b.place(p, player);
+                player = board::getOpponentPlayer(player);
+            }
+            benchmark::DoNotOptimize(b);
+            placed += moves.size();
+        }
+        state.SetItemsProcessed(placed);
+    }
+
+    template<std::size_t N>
+    void BM_CopyConstruct(benchmark::State &state)
+    {
+        using BT = Board<N, N>;
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            BT b(positions[i++ % POSITION_CNT]);
+            benchmark::DoNotOptimize(b);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    template<std::size_t N>
+    void BM_CopyAssign(benchmark::State &state)
+    {
+        using BT = Board<N, N>;
+        const auto &positions = getPositions<N, N>();
+        BT b;
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            b = positions[i++ % POSITION_CNT];
+            benchmark::DoNotOptimize(b);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Every point of a position for the player to move
+    template<std::size_t N>
+    void BM_GetPosStatus(benchmark::State &state)
+    {
+        using PT = typename Board<N, N>::PointType;
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            const auto &b = positions[i % POSITION_CNT];
+            Player player = getPlayer(i++);
+            for (char x = 0; x < static_cast<char>(N); ++x)
+                for (char y = 0; y < static_cast<char>(N); ++y)
+                    benchmark::DoNotOptimize(b.getPosStatus(PT {x, y}, player));
+        }
+        state.SetItemsProcessed(state.iterations() * N * N);
+    }
+
+    template<std::size_t N>
+    void BM_GetAllValidPosition(benchmark::State &state)
+    {
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            auto valid = positions[i % POSITION_CNT].getAllValidPosition(getPlayer(i));
+            ++i;
+            benchmark::DoNotOptimize(valid.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    template<std::size_t N>
+    void BM_GetAllGoodPosition(benchmark::State &state)
+    {
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            auto good = positions[i % POSITION_CNT].getAllGoodPosition(getPlayer(i));
+            ++i;
+            benchmark::DoNotOptimize(good.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Every legal move of a position for the player to move
+    template<std::size_t N>
+    void BM_IsSelfAtari(benchmark::State &state)
+    {
+        const auto &positions = getPositions<N, N>();
+        std::vector<typename Board<N, N>::PointType> valid[POSITION_CNT];
+        for (std::size_t i = 0; i < POSITION_CNT; ++i)
+            valid[i] = positions[i].getAllValidPosition(getPlayer(i));
+        std::size_t i = 0, checked = 0;
+        for (auto _: state)
+        {
+            const auto &b = positions[i % POSITION_CNT];
+            const auto &moves = valid[i % POSITION_CNT];
+            Player player = getPlayer(i++);
+            for (auto p: moves)
+                benchmark::DoNotOptimize(b.isSelfAtari(p, player));
+            checked += moves.size();
+        }
+        state.SetItemsProcessed(checked);
+    }
+
+    template<std::size_t N>
+    void BM_GenerateRequestV1(benchmark::State &state)
+    {
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            auto req = positions[i % POSITION_CNT].generateRequestV1(getPlayer(i));
+            ++i;
+            benchmark::DoNotOptimize(req);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    template<std::size_t N>
+    void BM_GenerateRequestV2(benchmark::State &state)
+    {
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            auto req = positions[i % POSITION_CNT].generateRequestV2(getPlayer(i));
+            ++i;
+            benchmark::DoNotOptimize(req);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Every point of a position for the player to move
+    template<std::size_t N>
+    void BM_GetPointScore(benchmark::State &state)
+    {
+        using PT = typename Board<N, N>::PointType;
+        const auto &positions = getPositions<N, N>();
+        std::size_t i = 0;
+        for (auto _: state)
+        {
+            const auto &b = positions[i % POSITION_CNT];
+            Player player = getPlayer(i++);
+            for (char x = 0; x < static_cast<char>(N); ++x)
+                for (char y = 0; y < static_cast<char>(N); ++y)
+                    benchmark::DoNotOptimize(b.getPointScore(PT {x, y}, player));
+        }
+        state.SetItemsProcessed(state.iterations() * N * N);
+    }
+
+    // Playouts from the empty board with Playout's default rules
+    template<std::size_t N>
+    void BM_Playout(benchmark::State &state)
+    {
+        using BT = Board<N, N>;
+        board::Playout<N, N> playout(SEED);
+        std::size_t moves = 0;
+        for (auto _: state)
+        {
+            BT b;
+            benchmark::DoNotOptimize(playout.play(b, Player::B));
+            moves += playout.getLastMoveCount();
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["moves_per_second"] = benchmark::Counter(static_cast<double>(moves),
+                                                                benchmark::Counter::kIsRate);
+    }
+}
+
+// One benchmark per size instantiated in board/board_class_templ_inst.cpp
+#define BOARD_BENCHMARK(func) \
+    BENCHMARK_TEMPLATE(func, 3); \
+    BENCHMARK_TEMPLATE(func, 4); \
+    BENCHMARK_TEMPLATE(func, 5); \
+    BENCHMARK_TEMPLATE(func, 9); \
+    BENCHMARK_TEMPLATE(func, 19)
+
+BOARD_BENCHMARK(BM_Place);
+BOARD_BENCHMARK(BM_CopyConstruct);
+BOARD_BENCHMARK(BM_CopyAssign);
+BOARD_BENCHMARK(BM_GetPosStatus);
+BOARD_BENCHMARK(BM_GetAllValidPosition);
+BOARD_BENCHMARK(BM_GetAllGoodPosition);
+BOARD_BENCHMARK(BM_IsSelfAtari);
+BOARD_BENCHMARK(BM_GenerateRequestV1);
+BOARD_BENCHMARK(BM_GenerateRequestV2);
+BOARD_BENCHMARK(BM_GetPointScore);
+BOARD_BENCHMARK(BM_Playout);
+
+BENCHMARK_MAIN();
@@ -5,9 +5,16 @@
 #include <cstddef>
 #include <vector>
 #include <map>
+#include <deque>
+#include <set>
 #include <functional>
 #include <gtest/gtest.h>
 #include <list>
+#include <type_traits>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <thread>
 #include "board.hpp"
 #include "logger.hpp"
 
@@ -64,6 +71,23 @@ TEST(BoardTest, TestGridPoint)
     EXPECT_EQ(2, point.x);
     EXPECT_EQ(18, point.y);
     EXPECT_TRUE(point.is_right());
+
+    // Neighbour lists hold what for_each_* visits, in the same order
+    using gp_t = board::GridPoint<19, 19>;
+    gp_t gp(2, 18);
+    auto adjacent = gp.get_adjacent_point();
+    ASSERT_EQ(3u, adjacent.size());
+    EXPECT_EQ(gp.left_point(), adjacent[0]);
+    EXPECT_EQ(gp.up_point(), adjacent[1]);
+    EXPECT_EQ(gp.down_point(), adjacent[2]);
+    EXPECT_EQ(2u, gp.get_diag_point().size());
+    std::size_t i = 0;
+    auto wrap8 = gp.get_wrap8_point();
+    gp.for_each_wrap8([&](gp_t p) {
+        EXPECT_EQ(p, wrap8[i++]);
+    });
+    EXPECT_EQ(5u, i);
+    EXPECT_EQ(wrap8.end(), wrap8.begin() + i);
 }
 
 template<std::size_t W, std::size_t H>
@@ -83,6 +107,21 @@ void randomScatter(board::Board<W, H> &b, std::size_t cnt)
     }
 };
 
+template<std::size_t W, std::size_t H>
+std::string boardSnapshot(const board::Board<W, H> &b)
+{
+    std::ostringstream oss;
+    oss << b << b.getStep() << ' ' << std::hash<board::Board<W, H>>()(b) << ' '
+        << (int)b.getSimpleKoPoint().x << ',' << (int)b.getSimpleKoPoint().y << '\n';
+    auto history = b.getHistoryCopy();
+    for (; !history.empty(); history.pop())
+        oss << (int)history.front().x << ',' << (int)history.front().y << ' ';
+    oss << '\n';
+    for (auto it = b.groupBegin(); it != b.groupEnd(); ++it)
+        oss << it->getLiberty() << '/' << it->getStoneCnt() << ' ';
+    return oss.str();
+}
+
 TEST(BoardTest, TestBoardGridHash)
 {
     using bg_t = board::BoardGrid<19, 19>;
@@ -130,24 +169,64 @@ TEST(BoardTest, TestGroupNode)
     EXPECT_EQ(Player::B, tail->getPlayer());
 }
 
+TEST(BoardTest, TestGroupPool)
+{
+    using namespace board;
+    using gn_t = GroupNode<19, 19>;
+    using gp_t = GroupPool<19, 19>;
+    gp_t gp;
+    EXPECT_EQ(gp.end(), gp.begin());
+
+    GroupId n1 = gp.alloc(gn_t(Player::B, 2));
+    GroupId n2 = gp.alloc(gn_t(Player::W, 3));
+    GroupId n3 = gp.alloc(gn_t(Player::B, 1));
+    EXPECT_EQ(3u, gp.size());
+    EXPECT_EQ(Player::W, gp[n2].getPlayer());
+
+    gp.free(n2);
+    EXPECT_EQ(2u, gp.size());
+    std::vector<GroupId> alive;
+    for (auto it = gp.begin(); it != gp.end(); ++it)
+        alive.push_back(it.id());
+    EXPECT_EQ(std::vector<GroupId>({n1, n3}), alive);
+
+    // freed id is reused first
+    EXPECT_EQ(n2, gp.alloc(gn_t(Player::B, 1)));
+    EXPECT_EQ(0u, gp[gp_t::NONE].getStoneCnt());
+}
+
+TEST(BoardTest, TestBoardTriviallyCopyable)
+{
+    using namespace board;
+    EXPECT_TRUE((std::is_trivially_copyable<Board<19, 19>>::value));
+    EXPECT_TRUE((std::is_trivially_copyable<Board<9, 9>>::value));
+
+    Board<9, 9> b;
+    randomScatter(b, 40);
+    Board<9, 9> c = b;
+    EXPECT_EQ(boardSnapshot(b), boardSnapshot(c));
+    auto valid = c.getAllValidPosition(Player::B);
+    c.place(valid.front(), Player::B);
+    EXPECT_NE(boardSnapshot(b), boardSnapshot(c));
+}
+
 TEST(BoardTest, TestPosGroup)
 {
     using namespace board;
     using gn_t = GroupNode<19, 19>;
-    using gnl_t = std::list<gn_t>;
-    gnl_t gnl;
+    using gp_t = GroupPool<19, 19>;
+    gp_t gp;
     auto logger = getGlobalLogger();
 
-    gnl.insert(gnl.cend(), gn_t(Player::B));
-    gnl.insert(gnl.cend(), gn_t(Player::W));
-    auto n1 = gnl.begin();
-    auto n2 = std::next(n1);
+    GroupId n1 = gp.alloc(gn_t(Player::B));
+    GroupId n2 = gp.alloc(gn_t(Player::W));
+    const GroupId none = gp_t::NONE;
 
-    PosGroup<19, 19> pg(gnl.end());
+    PosGroup<19, 19> pg(none);
     logger->info("Size of posgroup<19, 19>: {}", sizeof(pg));
 
     using PT = typename decltype(pg)::PointType;
-    EXPECT_EQ(gnl.end(), pg.get(PT{2, 4}));
+    EXPECT_EQ(none, pg.get(PT{2, 4}));
     pg.set(PT{18, 6}, n1);
     pg.set(PT{0, 18}, n2);
     pg.merge(PT{18, 6}, PT{0, 17});
@@ -161,7 +240,7 @@ TEST(BoardTest, TestPosGroup)
             else if ((i==0 && j==18) || (i==18 && j == 5))
                 EXPECT_EQ(n2, pg.get(PT{i, j}));
             else
-                EXPECT_EQ(gnl.end(), pg.get(PT{i, j}));
+                EXPECT_EQ(none, pg.get(PT{i, j}));
         }
 
     // self-merge n1 <- n1 should be okay
@@ -174,7 +253,7 @@ TEST(BoardTest, TestPosGroup)
             else if ((i==0 && j==18) || (i==18 && j == 5))
                 EXPECT_EQ(n2, pg.get(PT{i, j}));
             else
-                EXPECT_EQ(gnl.end(), pg.get(PT{i, j}));
+                EXPECT_EQ(none, pg.get(PT{i, j}));
         }
 
     // self-merge n2 <- n2 should be okay too
@@ -187,7 +266,7 @@ TEST(BoardTest, TestPosGroup)
             else if ((i==0 && j==18) || (i==18 && j == 5))
                 EXPECT_EQ(n2, pg.get(PT{i, j}));
             else
-                EXPECT_EQ(gnl.end(), pg.get(PT{i, j}));
+                EXPECT_EQ(none, pg.get(PT{i, j}));
         }
     pg.merge(PT{18, 6}, PT{ 18, 5 });
     pg.merge(PT{0, 18}, PT{18, 5});
@@ -199,10 +278,42 @@ TEST(BoardTest, TestPosGroup)
             else if ((i==0 && j==18) || (i==18 && j == 5))
                 EXPECT_EQ(n1, pg.get(PT{i, j})); // n2 should be n1 now
             else
-                EXPECT_EQ(gnl.end(), pg.get(PT{i, j}));
+                EXPECT_EQ(none, pg.get(PT{i, j}));
         }
 }
 
+TEST(BoardTest, TestPosGroupMergeRevert)
+{
+    using namespace board;
+    using pg_t = PosGroup<19, 19>;
+    using PT = typename pg_t::PointType;
+    const GroupId none = GroupPool<19, 19>::NONE;
+    pg_t pg(none);
+
+    // Grow row 0 one stone at a time from both ends. The id of the first argument always survives
+    for (char j=0; j<19; ++j)
+        pg.set(PT{0, j}, static_cast<GroupId>(j));
+    for (char j=1; j<10; ++j)
+        pg.merge(PT{0, 0}, PT{0, j});
+    for (char j=18; j>=10; --j)
+        pg.merge(PT{0, j}, PT{0, 0});
+    for (char j=0; j<19; ++j)
+        EXPECT_EQ(10, pg.get(PT{0, j}));
+
+    pg_t::ChangeLog log;
+    const pg_t before = pg;
+    pg.set(PT{1, 0}, 42, &log);
+    pg.merge(PT{1, 0}, PT{0, 5}, &log);
+    for (char j=0; j<19; ++j)
+        EXPECT_EQ(42, pg.get(PT{0, j}));
+    EXPECT_EQ(42, pg.get(PT{1, 0}));
+
+    pg.revert(log);
+    for (char i=0; i<19; ++i)
+        for (char j=0; j<19; ++j)
+            EXPECT_EQ(before.get(PT{i, j}), pg.get(PT{i, j}));
+}
+
 
 using GraphItem = std::pair<int, board::Player>;
 const GraphItem O = GraphItem(0, board::Player::B);
@@ -521,3 +632,1214 @@ TEST(BoardTest, TBoardTest_TestReqV1Generaton)
     auto reqv1 = b.generateRequestV1(Player::B);
     EXPECT_EQ(19 * 19, reqv1.our_group_lib1_size());
 }
+
+TEST(BoardTest, TestBoardJournalUndo)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    BT b;
+    BT::Journal journal;
+    std::vector<std::string> snapshots;
+    for (int i=0; i<150; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        auto valid = b.getAllValidPosition(player);
+        if (valid.empty())
+            break;
+        snapshots.push_back(boardSnapshot(b));
+        b.place(valid[std::rand() % valid.size()], player, journal);
+        // undo right away sometimes, and replay
+        if (i % 7 == 3)
+        {
+            std::string after = boardSnapshot(b);
+            PT last = b.getHistoryCopy().back();
+            b.undo(journal);
+            EXPECT_EQ(snapshots.back(), boardSnapshot(b));
+            b.place(last, player, journal);
+            EXPECT_EQ(after, boardSnapshot(b));
+        }
+    }
+    EXPECT_EQ(snapshots.size(), journal.size());
+    while (!journal.empty())
+    {
+        b.undo(journal);
+        EXPECT_EQ(snapshots.back(), boardSnapshot(b));
+        snapshots.pop_back();
+    }
+    EXPECT_EQ(0, b.getStep());
+}
+
+TEST(BoardTest, TestBoardZobristHash)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    BT b;
+    EXPECT_EQ(0u, b.getPositionHash());
+    for (int i=0; i<120; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        auto valid = b.getAllValidPosition(player);
+        if (valid.empty())
+            break;
+        b.place(valid[std::rand() % valid.size()], player);
+        std::uint64_t expected = 0;
+        PT::for_all([&](PT p) {
+            expected ^= Zobrist<9, 9>::stoneKey(p, b.getPointState(p));
+        });
+        EXPECT_EQ(expected, b.getPositionHash());
+        EXPECT_NE(b.getSituationHash(Player::B), b.getSituationHash(Player::W));
+    }
+
+    // Transposition: same stones by different move order
+    BT b1, b2;
+    b1.place(PT {2, 2}, Player::B);
+    b1.place(PT {6, 6}, Player::W);
+    b1.place(PT {2, 6}, Player::B);
+    b2.place(PT {2, 6}, Player::B);
+    b2.place(PT {6, 6}, Player::W);
+    b2.place(PT {2, 2}, Player::B);
+    EXPECT_EQ(b1.getPositionHash(), b2.getPositionHash());
+    EXPECT_EQ(b1.getSituationHash(Player::W), b2.getSituationHash(Player::W));
+    EXPECT_EQ(std::hash<BT>()(b1), std::hash<BT>()(b2));
+}
+
+TEST(BoardTest, TestBoardSuperko)
+{
+    using namespace board;
+    Board<5, 5> b;
+    using BT = Board<5, 5>;
+    using PT = typename BT::PointType;
+    b.setSuperko(true);
+    GraphItem graph[5][5] = {
+            {O,     1_b,    2_w,    O,      O},
+            {3_b,   8_w,    4_b,    5_w,    O},
+            {O,     6_b,    7_w,    O,      O},
+            {O,     O,      O,      O,      O},
+            {O,     O,      O,      O,      O}
+    };
+    auto points = graphToPoint<5, 5>(graph);
+    std::for_each(points.begin(), points.end(), [&](std::pair<board::GridPoint<5, 5>, board::Player> item) {
+        b.place(item.first, item.second);
+    });
+    // Retaking the ko recreates the position before 8_w
+    EXPECT_TRUE(b.isSuperko(PT {1, 2}, Player::B));
+    EXPECT_FALSE(b.isSuperko(PT {3, 3}, Player::B));
+    b.setSuperko(false);
+    EXPECT_FALSE(b.isSuperko(PT {1, 2}, Player::B));
+}
+
+TEST(BoardTest, TestBoardSuperkoMatchesHistory)
+{
+    using namespace board;
+    using BT = Board<5, 5>;
+    BT b;
+    BT::Journal journal;
+    b.setSuperko(true);
+    std::set<std::uint64_t> seen {b.getPositionHash()};
+    // Stay below the history capacity of 5x5, after which old positions are forgotten
+    for (int i=0; i<30; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        std::vector<BT::PointType> candidates;
+        BT::PointType::for_all([&](BT::PointType p) {
+            auto status = b.getPosStatus(p, player);
+            if (status != BT::PositionStatus::OK && status != BT::PositionStatus::SUPERKO)
+                return;
+            BT c = b;
+            c.place(p, player);
+            EXPECT_EQ(seen.count(c.getPositionHash()) > 0, b.isSuperko(p, player));
+            EXPECT_EQ(seen.count(c.getPositionHash()) > 0, status == BT::PositionStatus::SUPERKO);
+            if (status == BT::PositionStatus::OK)
+                candidates.push_back(p);
+        });
+        if (candidates.empty())
+            break;
+        b.place(candidates[std::rand() % candidates.size()], player, journal);
+        seen.insert(b.getPositionHash());
+    }
+    // Undo forgets positions that were remembered after the move
+    BT::PointType last = b.getHistoryCopy().back();
+    Player lastPlayer = b.getPointState(last) == PointState::B ? Player::B : Player::W;
+    b.undo(journal);
+    EXPECT_FALSE(b.isSuperko(last, lastPlayer));
+}
+
+TEST(BoardTest, TestHashHistoryEviction)
+{
+    using namespace board;
+    using HT = HashHistory<8>;
+    HT h;
+    // All with the same home slot, so forgetting one shifts the probe run
+    std::vector<std::uint64_t> keys {1, 9, 17, 25, 33, 41};
+    std::vector<HT::InsertRecord> records;
+    for (std::uint64_t key: keys)
+        records.push_back(h.insert(key));
+    EXPECT_EQ(HT::MAX_SIZE, h.size());
+    EXPECT_FALSE(h.contains(1));
+    EXPECT_FALSE(h.contains(9));
+    for (std::size_t i = 2; i < keys.size(); ++i)
+        EXPECT_TRUE(h.contains(keys[i]));
+    EXPECT_FALSE(h.insert(41).inserted);
+    for (std::size_t i = keys.size(); i-- > 0; )
+    {
+        h.undoInsert(records[i]);
+        for (std::size_t j = 0; j < keys.size(); ++j)
+            EXPECT_EQ(j < i && j + HT::MAX_SIZE >= i, h.contains(keys[j]));
+    }
+    EXPECT_EQ(0, h.size());
+
+    // Inserting a kept hash again makes it the newest, and undoing that makes it as old as it was
+    for (std::size_t i = 0; i < HT::MAX_SIZE; ++i)
+        h.insert(keys[i]);
+    HT::InsertRecord refresh = h.insert(9);
+    EXPECT_FALSE(refresh.inserted);
+    EXPECT_TRUE(refresh.refreshed);
+    EXPECT_EQ(HT::MAX_SIZE, h.size());
+    HT::InsertRecord evict1 = h.insert(33), evict2 = h.insert(41);
+    EXPECT_EQ(1u, evict1.evictedHash);
+    EXPECT_EQ(17u, evict2.evictedHash);
+    EXPECT_TRUE(h.contains(9));
+    h.undoInsert(evict2);
+    h.undoInsert(evict1);
+    h.undoInsert(refresh);
+    EXPECT_EQ(1u, h.insert(33).evictedHash);
+    EXPECT_EQ(9u, h.insert(41).evictedHash);
+    for (std::uint64_t key: {17, 25, 33, 41})
+        EXPECT_TRUE(h.contains(key));
+}
+
+TEST(BoardTest, TestBoardSuperkoAfterHistoryFull)
+{
+    using namespace board;
+    using BT = Board<5, 5>;
+    // Size of the superko history of 5x5
+    const std::size_t historySize = HashHistory<nextPowerOf2(5 * 5) * 2>::MAX_SIZE;
+    BT b;
+    BT::Journal journal;
+    b.setSuperko(true);
+    // The latest historySize positions, which must be exactly the remembered ones, before every move
+    std::deque<std::uint64_t> latest {b.getPositionHash()};
+    // latest and player to move before each move of the journal
+    std::vector< std::pair<std::deque<std::uint64_t>, Player> > snapshots;
+    auto remembered = [&](std::uint64_t hash) {
+        return std::find(latest.begin(), latest.end(), hash) != latest.end();
+    };
+    auto checkAll = [&](Player player) {
+        BT::PointType::for_all([&](BT::PointType p) {
+            auto status = b.getPosStatus(p, player);
+            if (status != BT::PositionStatus::OK && status != BT::PositionStatus::SUPERKO)
+                return;
+            BT c = b;
+            c.place(p, player);
+            EXPECT_EQ(remembered(c.getPositionHash()), b.isSuperko(p, player));
+        });
+    };
+    std::size_t passes = 0;
+    Player player = Player::B;
+    for (int i=0; i<400 && passes < 2; ++i, player = getOpponentPlayer(player))
+    {
+        checkAll(player);
+        // Filling eyes, which leads to big captures, keeps the game going. Pass if there is no legal move
+        std::vector<BT::PointType> candidates = b.getAllValidPosition(player);
+        if (candidates.empty())
+        {
+            ++passes;
+            continue;
+        }
+        passes = 0;
+        snapshots.emplace_back(latest, player);
+        b.place(candidates[std::rand() % candidates.size()], player, journal);
+        // A repeated position becomes the latest again
+        latest.erase(std::remove(latest.begin(), latest.end(), b.getPositionHash()), latest.end());
+        latest.push_back(b.getPositionHash());
+        if (latest.size() > historySize)
+            latest.pop_front();
+    }
+    ASSERT_GT(snapshots.size(), historySize * 2);
+    // Undo brings forgotten positions back
+    while (!snapshots.empty())
+    {
+        b.undo(journal);
+        latest = snapshots.back().first;
+        checkAll(snapshots.back().second);
+        snapshots.pop_back();
+    }
+}
+
+TEST(BoardTest, TestBoardTripleKoAfterHistoryFull)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    const std::size_t historySize = HashHistory<nextPowerOf2(9 * 9) * 2>::MAX_SIZE;
+    BT b;
+    BT::Journal journal;
+    b.setSuperko(true);
+    // Three kos. Black captures first in the kos at (0, 1) and (4, 0), white in the one at (0, 7)
+    std::vector< std::pair<PT, Player> > setup {
+            {PT {0, 0}, Player::B}, {PT {0, 1}, Player::W}, {PT {0, 3}, Player::W}, {PT {1, 1}, Player::B},
+            {PT {1, 2}, Player::W},
+            {PT {0, 8}, Player::W}, {PT {0, 7}, Player::B}, {PT {0, 5}, Player::B}, {PT {1, 7}, Player::W},
+            {PT {1, 6}, Player::B},
+            {PT {3, 0}, Player::B}, {PT {4, 0}, Player::W}, {PT {6, 0}, Player::W}, {PT {4, 1}, Player::B},
+            {PT {5, 1}, Player::W}
+    };
+    for (auto item: setup)
+        b.place(item.first, item.second);
+    // A black wall around rows and columns 4 to 8, where the history is filled without touching the kos
+    for (char i = 3; i < 9; ++i)
+        b.place(PT {3, i}, Player::B);
+    for (char i = 4; i < 9; ++i)
+        b.place(PT {i, 3}, Player::B);
+    // Rounds in which white fills all empty points of the corner but the last, and black captures them there.
+    // Black stones pile up from the end, so every position is new. Returns how many moves are played
+    auto fill = [&](std::size_t count) {
+        std::size_t moves = 0;
+        while (moves < count)
+        {
+            std::vector<PT> empty;
+            for (char x = 4; x < 9; ++x)
+                for (char y = 4; y < 9; ++y)
+                    if (b.getPointState(PT {x, y}) == PointState::NA)
+                        empty.push_back(PT {x, y});
+            if (empty.size() < 2)
+                break;
+            for (std::size_t i = 0; i < empty.size(); ++i)
+            {
+                Player player = i + 1 < empty.size() ? Player::W : Player::B;
+                EXPECT_EQ(BT::PositionStatus::OK, b.getPosStatus(empty[i], player));
+                b.place(empty[i], player, journal);
+            }
+            moves += empty.size();
+        }
+        return moves;
+    };
+    // A cycle of 6 moves, the last of which recreates the position before the first
+    std::vector< std::pair<PT, Player> > cycle {
+            {PT {0, 2}, Player::B}, {PT {0, 6}, Player::W}, {PT {5, 0}, Player::B},
+            {PT {0, 1}, Player::W}, {PT {0, 7}, Player::B}
+    };
+    PT last {4, 0};
+
+    ASSERT_GE(fill(historySize), historySize);
+    for (auto item: cycle)
+    {
+        ASSERT_EQ(BT::PositionStatus::OK, b.getPosStatus(item.first, item.second));
+        b.place(item.first, item.second, journal);
+    }
+    EXPECT_EQ(BT::PositionStatus::SUPERKO, b.getPosStatus(last, Player::W));
+
+    // Enough moves to forget the cycle, then undo them to bring it back
+    std::size_t filled = fill(historySize);
+    ASSERT_GE(filled, historySize);
+    for (std::size_t i = 0; i < filled; ++i)
+        b.undo(journal);
+    EXPECT_EQ(BT::PositionStatus::SUPERKO, b.getPosStatus(last, Player::W));
+    // Before the cycle, the capture is legal again
+    for (std::size_t i = 0; i < cycle.size(); ++i)
+        b.undo(journal);
+    EXPECT_EQ(BT::PositionStatus::OK, b.getPosStatus(cycle.front().first, Player::B));
+}
+
+TEST(BoardTest, TestBoardForEachStone)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    BT b;
+    BT::Journal journal;
+    for (int i=0; i<200; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        auto valid = b.getAllValidPosition(player);
+        if (valid.empty())
+            break;
+        b.place(valid[std::rand() % valid.size()], player, journal);
+
+        std::size_t stones_on_board = 0, stones_in_groups = 0;
+        PT::for_all([&](PT p) {
+            if (b.getPointState(p) != PointState::NA)
+                ++stones_on_board;
+        });
+        for (auto group = b.groupBegin(); group != b.groupEnd(); ++group)
+        {
+            std::size_t cnt = 0;
+            b.forEachStone(group, [&](PT p) {
+                EXPECT_EQ(group, b.getPointGroup(p));
+                ++cnt;
+            });
+            EXPECT_EQ(group->getStoneCnt(), cnt);
+            stones_in_groups += cnt;
+        }
+        EXPECT_EQ(stones_on_board, stones_in_groups);
+    }
+    while (!journal.empty())
+        b.undo(journal);
+    EXPECT_EQ(b.groupEnd(), b.groupBegin());
+}
+
+TEST(BoardTest, TestBoardLibertyCount)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    BT b;
+    for (int i=0; i<200; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        auto valid = b.getAllValidPosition(player);
+        if (valid.empty())
+            break;
+        b.place(valid[std::rand() % valid.size()], player);
+
+        for (auto group = b.groupBegin(); group != b.groupEnd(); ++group)
+        {
+            std::set<std::pair<int, int>> liberties;
+            b.forEachStone(group, [&](PT p) {
+                p.for_each_adjacent([&](PT adjP) {
+                    if (b.getPointState(adjP) == PointState::NA)
+                        liberties.insert(std::make_pair(adjP.x, adjP.y));
+                });
+            });
+            EXPECT_EQ(liberties.size(), group->getLiberty());
+            PT atariLiberty = b.getAtariLiberty(group);
+            if (liberties.size() == 1)
+            {
+                EXPECT_TRUE(group->isInAtari());
+                EXPECT_EQ(*liberties.begin(), std::make_pair((int)atariLiberty.x, (int)atariLiberty.y));
+            }
+            else
+                EXPECT_EQ(PT(-1, -1), atariLiberty);
+        }
+    }
+}
+
+TEST(BoardTest, TestPaddedLayout)
+{
+    using namespace board;
+    using L = PaddedLayout<5, 3>;
+    using PT = typename L::PointType;
+    std::size_t border_cnt = 0;
+    for (std::size_t v = 0; v < L::SIZE; ++v)
+        border_cnt += L::isBorder(v);
+    EXPECT_EQ(L::SIZE - 5 * 3, border_cnt);
+
+    PT::for_all([&](PT p) {
+        std::size_t v = L::vertex(p);
+        EXPECT_FALSE(L::isBorder(v));
+        EXPECT_EQ(p, L::point(v));
+
+        // Neighbours on board come in the order of GridPoint, the rest are border vertices
+        std::vector<std::size_t> adj, diag;
+        p.for_each_adjacent([&](PT adjP) { adj.push_back(L::vertex(adjP)); });
+        p.for_each_diag([&](PT adjP) { diag.push_back(L::vertex(adjP)); });
+        std::vector<std::size_t> adjByOffset, diagByOffset;
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            if (!L::isBorder(v + L::ADJ[i]))
+            {
+                adjByOffset.push_back(v + L::ADJ[i]);
+                EXPECT_EQ(v + L::ADJ[i], L::vertex(PT(p.x + L::ADJ_DX[i], p.y + L::ADJ_DY[i])));
+            }
+            if (!L::isBorder(v + L::DIAG[i]))
+            {
+                diagByOffset.push_back(v + L::DIAG[i]);
+                EXPECT_EQ(v + L::DIAG[i], L::vertex(PT(p.x + L::DIAG_DX[i], p.y + L::DIAG_DY[i])));
+            }
+        }
+        EXPECT_EQ(adj, adjByOffset);
+        EXPECT_EQ(diag, diagByOffset);
+    });
+}
+
+TEST(BoardTest, TestBoardLegalSet)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    BT b;
+    BT::Journal journal;
+    auto checkLegalSet = [&](const BT &b) {
+        for (Player player: {Player::B, Player::W})
+        {
+            std::size_t cnt = 0;
+            PT::for_all([&](PT p) {
+                bool legal = b.getPosStatus(p, player) == BT::PositionStatus::OK;
+                EXPECT_EQ(legal, b.getLegalSet(player).test(p));
+                if (legal)
+                {
+                    EXPECT_EQ(p, b.getNthLegal(player, cnt++));
+                }
+            });
+            EXPECT_EQ(cnt, b.getLegalCount(player));
+        }
+    };
+
+    EXPECT_EQ(81u, b.getLegalCount(Player::B));
+    for (int i=0; i<300; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        PT p = b.getNthLegal(player, std::rand() % b.getLegalCount(player));
+        if (i < 40)
+            b.place(p, player);
+        else
+            b.place(p, player, journal);
+        checkLegalSet(b);
+    }
+    while (!journal.empty())
+    {
+        b.undo(journal);
+        checkLegalSet(b);
+    }
+    b.clear();
+    checkLegalSet(b);
+}
+
+TEST(BoardTest, TestBoardBitboard)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    using BB = typename BT::BitboardType;
+    BT b;
+    for (int i=0; i<150; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        PT p = b.getNthLegal(player, std::rand() % b.getLegalCount(player));
+
+        // Capture set, taken before the move, matches stones which disappear
+        BB captured = b.getCaptureSet(p, player);
+        BB oppoBefore = b.getPlane(getPointStateFromPlayer(getOpponentPlayer(player)));
+        b.place(p, player);
+        EXPECT_EQ(oppoBefore - b.getPlane(getPointStateFromPlayer(getOpponentPlayer(player))), captured);
+
+        EXPECT_EQ(BB::full(), b.getPlane(PointState::NA) | b.getPlane(PointState::B) | b.getPlane(PointState::W));
+        for (auto group = b.groupBegin(); group != b.groupEnd(); ++group)
+        {
+            BB stones, liberties;
+            b.forEachStone(group, [&](PT stone) {
+                stones.set(stone);
+                stone.for_each_adjacent([&](PT adjP) {
+                    if (b.getPointState(adjP) == PointState::NA)
+                        liberties.set(adjP);
+                });
+            });
+            EXPECT_EQ(stones, b.getGroupStones(group->getHead()));
+            EXPECT_EQ(liberties, b.getGroupLibertySet(group->getHead()));
+            EXPECT_EQ(group->getLiberty(), liberties.count());
+        }
+    }
+    PT::for_all([&](PT p) {
+        if (b.getPointState(p) == PointState::NA)
+        {
+            EXPECT_TRUE(b.getEmptyRegion(p).test(p));
+        }
+    });
+    b.clear();
+    EXPECT_EQ(BB::full(), b.getEmptyRegion(PT(4, 4)));
+    EXPECT_EQ(81u, BB::full().count());
+}
+
+// Planes of msg, as repeated fields in order of field number
+template<typename MsgT>
+std::vector<std::vector<float>> requestPlanes(const MsgT &msg)
+{
+    const google::protobuf::Reflection *reflection = msg.GetReflection();
+    const google::protobuf::Descriptor *descriptor = msg.GetDescriptor();
+    std::vector<std::vector<float>> planes;
+    for (int i = 0; i < descriptor->field_count(); ++i)
+    {
+        const google::protobuf::FieldDescriptor *field = descriptor->field(i);
+        if (!field->is_repeated())
+            continue;
+        std::vector<float> plane;
+        for (int j = 0; j < reflection->FieldSize(msg, field); ++j)
+            plane.push_back(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_BOOL ?
+                            reflection->GetRepeatedBool(msg, field, j) : reflection->GetRepeatedFloat(msg, field, j));
+        planes.push_back(plane);
+    }
+    return planes;
+}
+
+TEST(BoardTest, TestBoardWriteFeaturePlanes)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using FS = BT::FeatureSet;
+    using FL = BT::FeatureLayout;
+    const std::size_t N = 81;
+    BT b;
+    std::vector<float> nchw(BT::FEATURE_V2_PLANES * N), nhwc(BT::FEATURE_V2_PLANES * N);
+    std::vector<std::uint8_t> bytes(BT::FEATURE_V2_PLANES * N);
+    for (int i=0; i<120; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        b.place(b.getNthLegal(player, std::rand() % b.getLegalCount(player)), player);
+        Player next = getOpponentPlayer(player);
+
+        for (FS set: {FS::V1, FS::V2, FS::V2Bug})
+        {
+            std::vector<std::vector<float>> expected =
+                    set == FS::V1 ? requestPlanes(b.generateRequestV1(next)) :
+                    set == FS::V2 ? requestPlanes(b.generateRequestV2(next)) : requestPlanes(b.generateRequestV2Bug(next));
+            std::size_t planes = BT::getFeaturePlaneCount(set);
+            ASSERT_EQ(planes, expected.size());
+            b.writeFeaturePlanes(next, nchw.data(), set, FL::NCHW);
+            b.writeFeaturePlanes(next, nhwc.data(), set, FL::NHWC);
+            b.writeFeaturePlanes(next, bytes.data(), set, FL::NCHW);
+            for (std::size_t c = 0; c < planes; ++c)
+                for (std::size_t idx = 0; idx < N; ++idx)
+                {
+                    EXPECT_FLOAT_EQ(expected[c][idx], nchw[c * N + idx]);
+                    EXPECT_EQ(nchw[c * N + idx], nhwc[idx * planes + c]);
+                    if (set != FS::V1 && c == BT::FEATURE_V2_POSITION_PLANE)
+                        EXPECT_NEAR(expected[c][idx] * 255, bytes[c * N + idx], 0.5f);
+                    else
+                        EXPECT_EQ(expected[c][idx], bytes[c * N + idx]);
+                }
+        }
+    }
+}
+
+TEST(BoardTest, TestFeatureCache)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using FS = BT::FeatureSet;
+    BT b;
+    BT::Journal journal;
+    for (FS set: {FS::V1, FS::V2, FS::V2Bug})
+    {
+        FeatureCache<9, 9> cache(set);
+        std::vector<std::uint8_t> expected(cache.size());
+        auto checkCache = [&]() {
+            for (Player player: {Player::B, Player::W})
+            {
+                b.writeFeaturePlanes(player, expected.data(), set);
+                EXPECT_TRUE(std::equal(expected.begin(), expected.end(), cache.data(player)));
+            }
+        };
+        b.clear();
+        EXPECT_FALSE(cache.update(b));
+        checkCache();
+        for (int i=0; i<150; ++i)
+        {
+            Player player = i % 2 ? Player::W : Player::B;
+            if (b.getLegalCount(player) == 0)
+                break;
+            b.place(b.getNthLegal(player, std::rand() % b.getLegalCount(player)), player, journal);
+            if (i % 10 == 9)
+                continue; // skipped update, next one rebuilds
+            EXPECT_EQ(i % 10 != 0 || i == 0, cache.update(b));
+            checkCache();
+        }
+        // A move made without change tracking can't be followed
+        b.setChangeTracking(false);
+        if (b.getLegalCount(Player::B) > 0)
+        {
+            b.place(b.getNthLegal(Player::B, 0), Player::B, journal);
+            EXPECT_FALSE(cache.update(b));
+            checkCache();
+        }
+        b.setChangeTracking(true);
+        // One move back lands on a board the cache hasn't seen, then one forward is incremental again
+        while (journal.size() > 2)
+        {
+            b.undo(journal);
+            cache.update(b);
+            checkCache();
+        }
+        journal.clear();
+    }
+}
+
+TEST(BoardTest, TestBoardRequestV3)
+{
+    using namespace board;
+    using BT = Board<19, 19>;
+    using FS = BT::FeatureSet;
+    const std::size_t N = 361;
+    BT b;
+    for (int i=0; i<200; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        b.place(b.getNthLegal(player, std::rand() % b.getLegalCount(player)), player);
+    }
+    std::vector<float> expected(BT::FEATURE_V2_PLANES * N), decoded(BT::FEATURE_V2_PLANES * N);
+    for (FS set: {FS::V1, FS::V2, FS::V2Bug})
+    {
+        std::size_t size = BT::getFeaturePlaneCount(set) * N;
+        gocnn::RequestV3 req = b.generateRequestV3(Player::B, set);
+        gocnn::RequestV3 parsed;
+        ASSERT_TRUE(parsed.ParseFromString(req.SerializeAsString()));
+        b.writeFeaturePlanes(Player::B, expected.data(), set);
+        BT::decodeRequestV3(parsed, decoded.data());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.begin() + size, decoded.begin()));
+    }
+    EXPECT_LT(b.generateRequestV3(Player::B).ByteSizeLong(), 2048u);
+    EXPECT_GT(b.generateRequestV2(Player::B).ByteSizeLong(), 5 * b.generateRequestV3(Player::B).ByteSizeLong());
+
+    std::vector<float> possibility(N), back(N);
+    for (std::size_t i = 0; i < N; ++i)
+        possibility[i] = static_cast<float>(std::rand()) / RAND_MAX;
+    possibility[0] = 0;
+    possibility[1] = 1;
+    possibility[2] = 1e-6f; // subnormal in half precision
+    for (auto encoding: {gocnn::ResponseV3::FLOAT16, gocnn::ResponseV3::UINT8})
+    {
+        BT::decodeResponseV3(BT::encodeResponseV3(possibility.data(), encoding), back.data());
+        float tolerance = encoding == gocnn::ResponseV3::UINT8 ? 0.5f / 255 : 1.0f / 2048;
+        for (std::size_t i = 0; i < N; ++i)
+            EXPECT_NEAR(possibility[i], back[i], std::max(tolerance * possibility[i], 1e-7f) +
+                    (encoding == gocnn::ResponseV3::UINT8 ? tolerance : 0));
+    }
+    // Exactly representable values, including the smallest normal and a subnormal
+    for (float v: {0.0f, 1.0f, -2.5f, 65504.0f, 6.103515625e-5f, 2.98023223876953125e-7f})
+        EXPECT_EQ(v, halfToFloat(floatToHalf(v)));
+    EXPECT_EQ(0x3c00, floatToHalf(1.0f));
+    EXPECT_EQ(0x7c00, floatToHalf(1e6f));
+    EXPECT_EQ(0x0001, floatToHalf(5.96e-8f));
+    EXPECT_FLOAT_EQ(5.9604645e-8f, halfToFloat(0x0001));
+}
+
+TEST(BoardTest, TestBoardRequestBatch)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    const std::size_t N = 81;
+    std::vector<BT> boards(5);
+    std::vector<std::pair<const BT *, Player>> positions;
+    for (std::size_t k = 0; k < boards.size(); ++k)
+    {
+        for (std::size_t i = 0; i < k * 10; ++i)
+        {
+            Player player = i % 2 ? Player::W : Player::B;
+            if (boards[k].getLegalCount(player) == 0)
+                break;
+            boards[k].place(boards[k].getNthLegal(player, std::rand() % boards[k].getLegalCount(player)), player);
+        }
+        positions.push_back(std::make_pair(&boards[k], k % 2 ? Player::W : Player::B));
+    }
+
+    gocnn::RequestBatch req = BT::generateRequestBatch(positions);
+    std::vector<float> expected(BT::FEATURE_V2_PLANES * N), decoded(BT::FEATURE_V2_PLANES * N);
+    for (std::size_t k = 0; k < boards.size(); ++k)
+    {
+        BT::decodeRequestV3(boards[k].generateRequestV3(positions[k].second), expected.data());
+        BT::decodeRequestBatch(req, k, decoded.data());
+        EXPECT_EQ(expected, decoded);
+    }
+    EXPECT_THROW(BT::decodeRequestBatch(req, boards.size(), decoded.data()), std::runtime_error);
+
+    std::vector<float> possibility(boards.size() * N), back(N);
+    for (float &v: possibility)
+        v = static_cast<float>(std::rand()) / RAND_MAX;
+    gocnn::ResponseBatch resp = BT::encodeResponseBatch(possibility.data(), boards.size(), gocnn::ResponseV3::FLOAT16);
+    for (std::size_t k = 0; k < boards.size(); ++k)
+    {
+        BT::decodeResponseBatch(resp, k, back.data());
+        for (std::size_t i = 0; i < N; ++i)
+            EXPECT_NEAR(possibility[k * N + i], back[i], possibility[k * N + i] / 1024);
+    }
+}
+
+TEST(BoardTest, TestBoardRequestReuse)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    BT b;
+    gocnn::RequestV2 reused;
+    google::protobuf::Arena arena;
+    const float *position = nullptr;
+    const bool *stones = nullptr;
+    for (int i=0; i<60; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        b.place(b.getNthLegal(player, std::rand() % b.getLegalCount(player)), player);
+
+        Player next = getOpponentPlayer(player);
+        b.generateRequestV2(next, reused);
+        EXPECT_EQ(b.generateRequestV2(next).SerializeAsString(), reused.SerializeAsString());
+        // Storage of the repeated fields is kept from the first fill on
+        if (i == 0)
+        {
+            position = reused.position().data();
+            stones = reused.stone_color_our().data();
+        }
+        EXPECT_EQ(position, reused.position().data());
+        EXPECT_EQ(stones, reused.stone_color_our().data());
+
+        b.generateRequestV2Bug(next, reused);
+        EXPECT_EQ(b.generateRequestV2Bug(next).SerializeAsString(), reused.SerializeAsString());
+        EXPECT_EQ(b.generateRequestV2(next).SerializeAsString(),
+                  b.generateRequestV2(next, &arena)->SerializeAsString());
+        EXPECT_EQ(b.generateRequestV1(next).SerializeAsString(),
+                  b.generateRequestV1(next, &arena)->SerializeAsString());
+    }
+}
+
+TEST(BoardTest, TestBoardPositionPlanes)
+{
+    using namespace board;
+    using BT = Board<19, 19>;
+    BT b;
+    gocnn::RequestV2 req = b.generateRequestV2(Player::B);
+    BT::PointType::for_all([&](BT::PointType p) {
+        int idx = p.x * 19 + p.y;
+        EXPECT_EQ(static_cast<float>(exp(-0.5 * (pow(p.x - 9.0, 2) + pow(p.y - 9.0, 2)))), req.position(idx));
+        EXPECT_EQ(p.x == 0 || p.y == 0 || p.x == 18 || p.y == 18, req.border(idx));
+    });
+}
+
+TEST(BoardTest, TestPlayout)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    Playout<9, 9> playout(42, 7.5);
+    const int N = 2000;
+    int blackWins = 0;
+    for (int i = 0; i < N; ++i)
+    {
+        BT b;
+        double score = playout.play(b, Player::B);
+        EXPECT_TRUE(b.isChangeTrackingEnabled());
+        EXPECT_LT(playout.getLastMoveCount(), 81u * 3);
+        // Nothing is left to play but own eyes, and every empty point belongs to one side
+        for (Player player: {Player::W, Player::B})
+            b.getLegalSet(player).forEach([&](BT::PointType p) {
+                EXPECT_TRUE(b.isTrueEye(p, player));
+            });
+        int area = 0;
+        BT::PointType::for_all([&](BT::PointType p) {
+            PointState state = b.getPointState(p);
+            if (state == PointState::NA)
+            {
+                bool black = false, white = false;
+                p.for_each_adjacent([&](BT::PointType adjP) {
+                    black = black || b.getPointState(adjP) == PointState::B;
+                    white = white || b.getPointState(adjP) == PointState::W;
+                });
+                EXPECT_NE(black, white);
+                area += black ? 1 : -1;
+            }
+            else
+                area += state == PointState::B ? 1 : -1;
+        });
+        EXPECT_EQ(area - 7.5, score);
+        blackWins += score > 0;
+    }
+    EXPECT_GT(blackWins, 0);
+    EXPECT_LT(blackWins, N);
+}
+
+TEST(BoardTest, TestPlayoutRunner)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    BT b;
+    // Black walls off the left, white the right
+    for (int i = 0; i < 9; ++i)
+    {
+        b.place(BT::PointType(i, 3), Player::B);
+        b.place(BT::PointType(i, 4), Player::W);
+    }
+    const std::size_t N = 1000;
+    for (std::size_t threads: {1, 4})
+    {
+        PlayoutRunner<9, 9> runner(threads, 7.5, 1);
+        EXPECT_EQ(threads, runner.getThreadCount());
+        auto start = std::chrono::steady_clock::now();
+        PlayoutRunner<9, 9>::Result result = runner.run(b, Player::W, N);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        getGlobalLogger()->info("PlayoutRunner<9, 9> with {} threads: {} playouts/s", threads, N / seconds);
+        EXPECT_EQ(N, result.playouts);
+        EXPECT_DOUBLE_EQ(1.0, result.getWinRate(Player::B) + result.getWinRate(Player::W));
+        for (float o: result.ownership)
+        {
+            EXPECT_GE(o, -1.0f);
+            EXPECT_LE(o, 1.0f);
+        }
+        EXPECT_GT(result.ownership[0], 0.3f);
+        EXPECT_LT(result.ownership[80], -0.3f);
+    }
+    EXPECT_EQ(0u, (PlayoutRunner<9, 9>(3).run(b, Player::B, 0).playouts));
+    EXPECT_EQ(2u, (PlayoutRunner<9, 9>(3).run(b, Player::B, 2).playouts));
+}
+
+TEST(BoardTest, TestMCTS)
+{
+    using namespace board;
+    using BT = Board<5, 5>;
+    using PT = BT::PointType;
+    BT b;
+    // White 3 stones in atari, to be captured at (2, 4)
+    for (PT p: {PT(2, 1), PT(2, 2), PT(2, 3)})
+        b.place(p, Player::W);
+    for (PT p: {PT(1, 1), PT(1, 2), PT(1, 3), PT(3, 1), PT(3, 2), PT(3, 3), PT(2, 0)})
+        b.place(p, Player::B);
+    const std::size_t N = 2000;
+    for (std::size_t threads: {1, 4})
+    {
+        MCTS<5, 5> mcts(threads, 1 << 16, 0.5, threads);
+        EXPECT_EQ(PT(2, 4), mcts.search(b, Player::B, N));
+        EXPECT_EQ(N, mcts.getRootVisits());
+        std::size_t childVisits = 0;
+        for (const MCTS<5, 5>::MoveStat &stat: mcts.getRootStats())
+        {
+            childVisits += stat.visits;
+            EXPECT_GE(stat.winRate, 0.0);
+            EXPECT_LE(stat.winRate, 1.0);
+        }
+        // Threads wait for root to be expanded, so every simulation goes through a child
+        EXPECT_EQ(N, childVisits);
+    }
+
+    // Priors are normalised, and the tree stops growing when the arena is full
+    MCTS<5, 5> mcts(1, 100);
+    mcts.setPrior(MCTS<5, 5>::possibilityPrior([](const BT &, Player, float *possibility) {
+        std::fill(possibility, possibility + 25, 1.0f);
+        possibility[2 * 5 + 4] = 3.0f;
+    }));
+    mcts.search(b, Player::B, 500);
+    std::vector<MCTS<5, 5>::MoveStat> stats = mcts.getRootStats();
+    for (const MCTS<5, 5>::MoveStat &stat: stats)
+        EXPECT_FLOAT_EQ((stat.move == PT(2, 4) ? 3.0f : 1.0f) / (stats.size() + 2), stat.prior);
+    EXPECT_EQ(500u, mcts.getRootVisits());
+    EXPECT_LE(mcts.getNodeCount(), 100u);
+}
+
+TEST(BoardTest, TestTranspositionTable)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = BT::PointType;
+    using TT = TranspositionTable<9, 9>;
+    TT tt(1000);
+    EXPECT_EQ(1024u, tt.getBucketCount());
+    EXPECT_EQ(4096u, tt.getCapacity());
+
+    // Keyed by stones and side to move
+    BT b;
+    b.place(PT(2, 2), Player::B);
+    TT::Entry entry, got;
+    entry.visits = 42;
+    entry.winRate = 0.25f;
+    entry.bestMove = PT(6, 6);
+    tt.store(b, Player::W, entry);
+    EXPECT_FALSE(tt.probe(b, Player::B, got));
+    ASSERT_TRUE(tt.probe(b, Player::W, got));
+    EXPECT_EQ(42u, got.visits);
+    EXPECT_NEAR(0.25f, got.winRate, 1.0f / 65535);
+    EXPECT_EQ(PT(6, 6), got.bestMove);
+    BT other;
+    other.place(PT(2, 2), Player::B);
+    EXPECT_TRUE(tt.probe(other, Player::W, got));
+    other.place(PT(3, 3), Player::W);
+    EXPECT_FALSE(tt.probe(other, Player::B, got));
+
+    // Same key is overwritten in place. Empty entries and passes
+    entry.visits = 50;
+    entry.bestMove = PT(-1, -1);
+    tt.store(b, Player::W, entry);
+    ASSERT_TRUE(tt.probe(b, Player::W, got));
+    EXPECT_EQ(50u, got.visits);
+    EXPECT_EQ(PT(-1, -1), got.bestMove);
+    EXPECT_EQ(1u, tt.countUsed());
+    entry.visits = 0;
+    tt.store(123, entry);
+    EXPECT_FALSE(tt.probe(123, got));
+    tt.clear();
+    EXPECT_FALSE(tt.probe(b, Player::W, got));
+
+    // Replacement in a full bucket
+    auto fill = [](TT &t) {
+        for (std::uint32_t i = 1; i <= 4; ++i)
+        {
+            TT::Entry e;
+            e.visits = i * 10;
+            t.store(i, e);
+        }
+    };
+    TT::Entry small, big;
+    small.visits = 5;
+    big.visits = 15;
+    TT visitsTT(1, TT::ReplacePolicy::VISITS);
+    fill(visitsTT);
+    visitsTT.store(5, small);
+    EXPECT_FALSE(visitsTT.probe(5, got));
+    visitsTT.store(6, big);
+    EXPECT_TRUE(visitsTT.probe(6, got));
+    EXPECT_FALSE(visitsTT.probe(1, got));
+    EXPECT_TRUE(visitsTT.probe(2, got));
+
+    TT agedTT(1, TT::ReplacePolicy::AGED_VISITS);
+    fill(agedTT);
+    agedTT.store(5, small);
+    EXPECT_FALSE(agedTT.probe(5, got));
+    agedTT.newSearch();
+    agedTT.store(5, small);
+    EXPECT_TRUE(agedTT.probe(5, got));
+    EXPECT_EQ(4u, agedTT.countUsed());
+
+    TT alwaysTT(1, TT::ReplacePolicy::ALWAYS);
+    fill(alwaysTT);
+    alwaysTT.store(5, small);
+    EXPECT_TRUE(alwaysTT.probe(5, got));
+    EXPECT_EQ(4u, alwaysTT.countUsed());
+
+    // Threads racing on a few buckets never read an entry stored under another key
+    TT shared(4, TT::ReplacePolicy::ALWAYS);
+    auto expected = [](std::uint64_t key) {
+        TT::Entry e;
+        e.visits = static_cast<std::uint32_t>(key % 1000 + 1);
+        e.bestMove = PT(static_cast<char>(key % 9), static_cast<char>(key / 9 % 9));
+        return e;
+    };
+    std::vector<std::size_t> bad(4), hits(4);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < 4; ++t)
+        threads.emplace_back([&, t]() {
+            std::uint64_t key = 0x9e3779b97f4a7c15ull * (t + 1);
+            for (std::size_t i = 0; i < 100000; ++i)
+            {
+                key = key * 6364136223846793005ull + 1442695040888963407ull;
+                std::uint64_t k = (key >> 58) * 0xff51afd7ed558ccdull; // few distinct keys, so that probes often hit
+                TT::Entry e = expected(k), found;
+                if (i % 2)
+                    shared.store(k, e);
+                else if (shared.probe(k, found))
+                {
+                    ++hits[t];
+                    bad[t] += found.visits != e.visits || found.bestMove != e.bestMove;
+                }
+            }
+        });
+    for (std::thread &t: threads)
+        t.join();
+    for (std::size_t t = 0; t < 4; ++t)
+    {
+        EXPECT_GT(hits[t], 0u);
+        EXPECT_EQ(0u, bad[t]);
+    }
+}
+
+TEST(BoardTest, TestPatternCode)
+{
+    using namespace board;
+    using BT = Board<5, 5>;
+    using PT = BT::PointType;
+    BT b;
+    const PointState NA = PointState::NA, BORDER = PaddedLayout<5, 5>::BORDER;
+    const bool noAtari[4] = {false, false, false, false};
+    const PointState cornerStates[8] = {BORDER, BORDER, NA, NA, BORDER, BORDER, BORDER, NA};
+    EXPECT_EQ(PatternCode::make(cornerStates, noAtari), b.getPatternCode(PT(0, 0)));
+
+    // White stone at (1, 2) in atari, black stones around it
+    b.place(PT(1, 2), Player::W);
+    b.place(PT(0, 2), Player::B);
+    b.place(PT(1, 1), Player::B);
+    b.place(PT(1, 3), Player::B);
+    std::uint32_t code = b.getPatternCode(PT(2, 2));
+    EXPECT_EQ(PointState::W, PatternCode::getState(code, 1));
+    EXPECT_TRUE(PatternCode::isInAtari(code, 1));
+    EXPECT_EQ(PointState::B, PatternCode::getState(code, 4));
+    EXPECT_EQ(PointState::B, PatternCode::getState(code, 6));
+    EXPECT_FALSE(PatternCode::isInAtari(code, 0));
+
+    // Capture it, then take it back
+    BT::Journal journal;
+    b.place(PT(2, 2), Player::B, journal);
+    code = b.getPatternCode(PT(1, 2));
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(PointState::B, PatternCode::getState(code, i));
+        EXPECT_FALSE(PatternCode::isInAtari(code, i));
+    }
+    b.undo(journal);
+    EXPECT_EQ(PointState::W, PatternCode::getState(b.getPatternCode(PT(2, 2)), 1));
+    EXPECT_TRUE(PatternCode::isInAtari(b.getPatternCode(PT(2, 2)), 1));
+    EXPECT_FALSE(PatternCode::isInAtari(b.getPatternCode(PT(1, 2)), 0));
+
+    // Symmetries match turning and mirroring the board
+    BT turned, mirrored;
+    PT::for_all([&](PT p) {
+        PointState s = b.getPointState(p);
+        if (s == NA)
+            return;
+        Player player = s == PointState::B ? Player::B : Player::W;
+        turned.place(PT(p.y, 4 - p.x), player);
+        mirrored.place(PT(p.x, 4 - p.y), player);
+    });
+    PT::for_all([&](PT p) {
+        EXPECT_EQ(PatternCode::rotate(b.getPatternCode(p)), turned.getPatternCode(PT(p.y, 4 - p.x)));
+        EXPECT_EQ(PatternCode::mirror(b.getPatternCode(p)), mirrored.getPatternCode(PT(p.x, 4 - p.y)));
+    });
+
+    PatternTable table(0.5f);
+    code = b.getPatternCode(PT(2, 2));
+    table.setSymmetric(code, 2.0f);
+    EXPECT_FLOAT_EQ(2.0f, table.get(code));
+    EXPECT_FLOAT_EQ(2.0f, table.get(PatternCode::rotate(code)));
+    EXPECT_FLOAT_EQ(2.0f, table.get(PatternCode::mirror(code)));
+    EXPECT_FLOAT_EQ(2.0f, table.get(PatternCode::swapColours(code), Player::W));
+    EXPECT_FLOAT_EQ(0.5f, table.get(PatternCode::swapColours(code)));
+    EXPECT_EQ(code, PatternCode::swapColours(PatternCode::swapColours(code)));
+}
+
+TEST(BoardTest, TestBoardLowLibertyGroups)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = typename BT::PointType;
+    auto check = [](const BT &b) {
+        for (Player player: {Player::W, Player::B})
+        {
+            std::set<GroupId> atari, two;
+            for (auto group = b.groupBegin(); group != b.groupEnd(); ++group)
+                if (group->getPlayer() == player && group->getLiberty() <= 2)
+                    (group->getLiberty() == 1 ? atari : two).insert(group.id());
+            auto isLiberty = [&](BT::GroupConstIterator group, PT p) {
+                bool found = false;
+                b.forEachStone(group, [&](PT stone) {
+                    found = found || stone.adjacent_to(p);
+                });
+                return found && b.getPointState(p) == PointState::NA;
+            };
+            std::set<GroupId> listed;
+            b.forEachAtariGroup(player, [&](BT::GroupConstIterator group, PT liberty) {
+                listed.insert(group.id());
+                EXPECT_TRUE(isLiberty(group, liberty));
+                EXPECT_EQ(liberty, b.getAtariLiberty(group));
+            });
+            EXPECT_EQ(atari, listed);
+            EXPECT_EQ(atari.size(), b.getAtariGroupCount(player));
+            listed.clear();
+            b.forEachTwoLibertyGroup(player, [&](BT::GroupConstIterator group, PT liberty1, PT liberty2) {
+                listed.insert(group.id());
+                EXPECT_NE(liberty1, liberty2);
+                EXPECT_TRUE(isLiberty(group, liberty1));
+                EXPECT_TRUE(isLiberty(group, liberty2));
+                EXPECT_EQ(liberty2, b.getLowLiberties(group)[1]);
+            });
+            EXPECT_EQ(two, listed);
+            EXPECT_EQ(two.size(), b.getTwoLibertyGroupCount(player));
+        }
+    };
+
+    BT b;
+    BT::Journal journal;
+    for (int i = 0; i < 200; ++i)
+    {
+        Player player = i % 2 ? Player::W : Player::B;
+        if (b.getLegalCount(player) == 0)
+            break;
+        b.place(b.getNthLegal(player, std::rand() % b.getLegalCount(player)), player, journal);
+        check(b);
+        if (std::rand() % 4 == 0)
+        {
+            b.undo(journal);
+            check(b);
+        }
+    }
+    while (!journal.empty())
+    {
+        b.undo(journal);
+        check(b);
+    }
+    EXPECT_EQ(0u, b.getAtariGroupCount(Player::B) + b.getTwoLibertyGroupCount(Player::W));
+}
+
+TEST(BoardTest, TestTacticalReader)
+{
+    using namespace board;
+    using BT = Board<9, 9>;
+    using PT = BT::PointType;
+    using TR = TacticalReader<9, 9>;
+    TR reader;
+    // White stone with 2 liberties, which black can ladder either way
+    BT b;
+    b.place(PT(4, 4), Player::W);
+    b.place(PT(3, 4), Player::B);
+    b.place(PT(4, 3), Player::B);
+    b.place(PT(5, 5), Player::B);
+    PT move;
+    EXPECT_EQ(TR::Outcome::DEAD, reader.readLadder(b, PT(4, 4), Player::B, move));
+    EXPECT_TRUE(move == PT(4, 5) || move == PT(5, 4));
+    EXPECT_EQ(TR::Outcome::ALIVE, reader.readLadder(b, PT(4, 4), Player::W, move));
+    EXPECT_TRUE(reader.isLadderCapture(b, PT(4, 5), Player::B));
+    EXPECT_FALSE(reader.isLadderCapture(b, PT(0, 0), Player::B));
+    // The same read again is answered by the cache
+    reader.readLadder(b, PT(4, 4), Player::B);
+    EXPECT_EQ(1u, reader.getNodeCount());
+
+    // A white stone on the way of the ladder down and left breaks it
+    BT broken = b;
+    broken.place(PT(6, 2), Player::W);
+    broken.place(PT(4, 5), Player::B);
+    BT working = b;
+    working.place(PT(4, 5), Player::B);
+    EXPECT_EQ(TR::Outcome::ALIVE, reader.readLadder(broken, PT(4, 4), Player::W, move));
+    EXPECT_EQ(PT(5, 4), move);
+    EXPECT_EQ(TR::Outcome::DEAD, reader.readLadder(working, PT(4, 4), Player::W, move));
+    EXPECT_TRUE(reader.isLadderEscape(broken, PT(5, 4), Player::W));
+    EXPECT_FALSE(reader.isLadderEscape(working, PT(5, 4), Player::W));
+    // In atari with black to move, it is simply taken
+    EXPECT_EQ(TR::Outcome::DEAD, reader.readCapture(working, PT(4, 4), Player::B, move));
+    EXPECT_EQ(PT(5, 4), move);
+
+    // Out of budget
+    TR small(3);
+    EXPECT_EQ(TR::Outcome::UNKNOWN, small.readCapture(b, PT(4, 4), Player::B));
+    small.setNodeBudget(100000);
+    EXPECT_EQ(TR::Outcome::DEAD, small.readCapture(b, PT(4, 4), Player::B));
+    // A stone in the open with 4 liberties is beyond reading
+    BT open;
+    open.place(PT(4, 4), Player::W);
+    EXPECT_EQ(TR::Outcome::ALIVE, small.readCapture(open, PT(4, 4), Player::B));
+    EXPECT_THROW(small.readLadder(open, PT(0, 0), Player::B), std::runtime_error);
+}
+
+TEST(BoardTest, TestBoardAreaScore)
+{
+    using namespace board;
+    using BT = Board<5, 5>;
+    using PT = BT::PointType;
+    BT b;
+    EXPECT_DOUBLE_EQ(-7.5, b.getAreaScore(7.5));
+    EXPECT_EQ(0u, b.getArea(Player::B).count());
+
+    // A lone stone owns the whole board by Tromp-Taylor, but only its neighbours by the playout scorer
+    b.place(PT(2, 2), Player::B);
+    EXPECT_EQ(25u, b.getArea(Player::B).count());
+    EXPECT_DOUBLE_EQ(25, b.getAreaScore(0));
+    EXPECT_EQ(5u, b.getPlayoutArea(Player::B).count());
+    EXPECT_DOUBLE_EQ(4.5, b.getPlayoutScore(0.5));
+
+    // Black wall on column 1, white on column 3. Column 0 is black's, column 4 white's, column 2 dame
+    BT walls;
+    for (int i = 0; i < 5; ++i)
+    {
+        walls.place(PT(i, 1), Player::B);
+        walls.place(PT(i, 3), Player::W);
+    }
+    EXPECT_EQ(10u, walls.getArea(Player::B).count());
+    EXPECT_EQ(10u, walls.getArea(Player::W).count());
+    EXPECT_FALSE(walls.getArea(Player::B).test(PT(2, 2)));
+    EXPECT_TRUE(walls.getArea(Player::W).test(PT(2, 4)));
+    EXPECT_DOUBLE_EQ(-0.5, walls.getAreaScore(0.5));
+    // Every empty point is eye-like or dame here, so both scorers agree
+    EXPECT_EQ(walls.getArea(Player::B), walls.getPlayoutArea(Player::B));
+    EXPECT_DOUBLE_EQ(walls.getAreaScore(7.5), walls.getPlayoutScore(7.5));
+}